@@ -0,0 +1,70 @@
+#include "fft.hpp"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+/**
+ * Times Fft::RealFft of the backend this file is built with, forward and
+ * inverse for the sizes from 256 to 8192. Each figure is the best of several
+ * runs, to keep the scheduler out of the numbers.
+ */
+
+#ifdef PACKGAMMA_FFT_GAMMA
+static const char* const BACKEND = "gamma";
+#else
+static const char* const BACKEND = "pffft";
+#endif
+
+/** Transforms of each run are about this many samples */
+static const int SAMPLES = 1 << 22;
+static const int RUNS = 7;
+
+/** Keeps the results alive */
+static volatile float sink;
+
+template <typename F>
+static double best(int iterations, F f) {
+	double best = INFINITY;
+	for (int r = 0; r < RUNS; r++) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			f();
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		best = std::min(best, ns / iterations);
+	}
+	return best;
+}
+
+int main() {
+	std::printf("Fft::RealFft, %s backend\n\n", BACKEND);
+	std::printf("%6s %12s %12s %14s\n", "size", "forward", "inverse", "ns per sample");
+
+	for (int length = 256; length <= 8192; length *= 2) {
+		Fft::RealFft fft(length);
+		// The samples on the alignment the backends need, as in Fft::Stft
+		float* in = Fft::alignedNew(length);
+		std::vector<float> bins(length + 2);
+		float* out = Fft::alignedNew(length);
+		// A fixed noise signal, the timing does not depend on the values
+		uint32_t seed = 1;
+		for (int i = 0; i < length; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			in[i] = (seed >> 8) / 8388608.f - 1.f;
+		}
+
+		int iterations = std::max(SAMPLES / length, 1);
+		double forward = best(iterations, [&]() {
+			fft.forward(in, bins.data());
+			sink = bins[1 + length / 2];
+		});
+		double inverse = best(iterations, [&]() {
+			fft.inverse(bins.data(), out);
+			sink = out[length / 2];
+		});
+		std::printf("%6d %9.2f us %9.2f us %14.3f\n", length, forward / 1000.0, inverse / 1000.0, (forward + inverse) / (2.0 * length));
+		Fft::alignedDelete(in);
+		Fft::alignedDelete(out);
+	}
+	return 0;
+}
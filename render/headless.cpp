@@ -0,0 +1,24 @@
+#include "headless.hpp"
+#include <context.hpp>
+#include <engine/Engine.hpp>
+
+namespace Render {
+
+plugin::Plugin* init() {
+	settings::devMode = true;
+	random::init();
+	asset::init();
+	logger::init();
+	contextSet(new Context);
+	APP->engine = new engine::Engine;
+
+	plugin::Plugin* plugin = new plugin::Plugin;
+	::init(plugin);
+	return plugin;
+}
+
+void destroy() {
+	logger::destroy();
+}
+
+} // namespace Render
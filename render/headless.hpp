@@ -0,0 +1,14 @@
+#pragma once
+#include "plugin.hpp"
+
+/**
+ * Rack without window, audio or engine thread, for the command line tools
+ * which drive the modules directly
+ */
+namespace Render {
+
+/** Logs to stderr, keeps assets in the working directory and initializes the plugin */
+plugin::Plugin* init();
+void destroy();
+
+} // namespace Render
@@ -0,0 +1,156 @@
+#include "patch.hpp"
+#include "wav.hpp"
+#include "headless.hpp"
+#include <context.hpp>
+#include <engine/Engine.hpp>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <set>
+
+static void usage() {
+	std::fprintf(stderr,
+		"Usage: packgamma-render [-j THREADS] [-o DIR] PATCH.json [INPUT.wav ...]\n"
+		"\n"
+		"Renders the jobs of PATCH.json and every INPUT.wav, the latter to DIR\n"
+		"under the same name, so -o is required with input files. See README.md\n"
+		"for the patch format.\n");
+}
+
+static std::string baseName(const std::string& path) {
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/** Absolute path with the links of the directory resolved, the file itself does not have to exist */
+static std::string resolve(const std::string& path) {
+	size_t slash = path.find_last_of("/\\");
+	std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+	char buffer[PATH_MAX];
+	if (!realpath(dir.c_str(), buffer))
+		return path;
+	std::string file = baseName(path);
+	// The file may be a link to the input as well
+	std::string full = std::string(buffer) + "/" + file;
+	if (realpath(full.c_str(), buffer))
+		return buffer;
+	return full;
+}
+
+int main(int argc, char* argv[]) {
+	int threads = std::max((int)std::thread::hardware_concurrency(), 1);
+	std::string dir;
+	std::string patchPath;
+	std::vector<std::string> inputs;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-j" && i + 1 < argc)
+			threads = std::max(std::atoi(argv[++i]), 1);
+		else if (arg == "-o" && i + 1 < argc)
+			dir = argv[++i];
+		else if (arg[0] == '-') {
+			usage();
+			return 2;
+		}
+		else if (patchPath.empty())
+			patchPath = arg;
+		else
+			inputs.push_back(arg);
+	}
+	if (patchPath.empty() || (!inputs.empty() && dir.empty())) {
+		usage();
+		return 2;
+	}
+
+	plugin::Plugin* plugin = Render::init();
+
+	Render::Patch patch;
+	if (!patch.load(patchPath, plugin)) {
+		std::fprintf(stderr, "%s\n", patch.error.c_str());
+		return 1;
+	}
+	for (const std::string& input : inputs) {
+		Render::Job job;
+		job.input = input;
+		job.output = dir + "/" + baseName(input);
+		patch.jobs.push_back(job);
+	}
+	if (patch.jobs.empty()) {
+		std::fprintf(stderr, "Nothing to render\n");
+		return 1;
+	}
+	// The writer truncates its file while a reader may still stream it, and
+	// two jobs writing one file would garble each other
+	std::set<std::string> sources;
+	for (const Render::Job& job : patch.jobs) {
+		if (!job.input.empty())
+			sources.insert(resolve(job.input));
+	}
+	std::set<std::string> outputs;
+	for (const Render::Job& job : patch.jobs) {
+		std::string output = resolve(job.output);
+		if (sources.count(output)) {
+			std::fprintf(stderr, "%s would overwrite an input, choose another output directory\n", job.output.c_str());
+			return 1;
+		}
+		if (!outputs.insert(output).second) {
+			std::fprintf(stderr, "%s is the output of more than one job\n", job.output.c_str());
+			return 1;
+		}
+	}
+
+	// Gamma's domain and the engine are shared by all instances, so the
+	// whole batch runs at one sample rate, by default the first input's
+	if (patch.sampleRate <= 0.f) {
+		patch.sampleRate = 48000.f;
+		for (const Render::Job& job : patch.jobs) {
+			Wav::Reader reader;
+			if (!job.input.empty() && reader.open(job.input)) {
+				patch.sampleRate = reader.sampleRate;
+				break;
+			}
+		}
+	}
+	// The instances which render are created after this and pick up the rate in their constructors
+	APP->engine->setSampleRate(patch.sampleRate);
+
+	// Work queue of independent jobs, every worker renders with its own chain of instances
+	std::atomic<size_t> next{0};
+	std::atomic<int> failed{0};
+	std::mutex printMutex;
+	auto work = [&]() {
+		size_t i;
+		while ((i = next++) < patch.jobs.size()) {
+			const Render::Job& job = patch.jobs[i];
+			auto start = std::chrono::steady_clock::now();
+			std::string error;
+			bool ok = Render::render(patch, job, error);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			std::lock_guard<std::mutex> lock(printMutex);
+			if (ok) {
+				std::printf("%s (%.2f s)\n", job.output.c_str(), seconds);
+			}
+			else {
+				std::fprintf(stderr, "%s: %s\n", job.output.c_str(), error.c_str());
+				failed++;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	threads = std::min(threads, (int)patch.jobs.size());
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back(work);
+	}
+	for (std::thread& t : workers) {
+		t.join();
+	}
+
+	Render::destroy();
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,274 @@
+#include "patch.hpp"
+#include "wav.hpp"
+#include <cstdlib>
+#include <mutex>
+
+namespace Render {
+
+/** Frames read, processed and written at once */
+static const int BLOCK = 1024;
+/** Gamma's objects attach to and detach from its global domain when they are created and deleted */
+static std::mutex domainMutex;
+
+Patch::~Patch() {
+	for (Stage& s : stages) {
+		if (s.data)
+			json_decref(s.data);
+	}
+}
+
+bool Patch::fail(const std::string& message) {
+	error = message;
+	return false;
+}
+
+/** Port or parameter id from an object key, either a number or a parameter label */
+static int idOf(const char* key, Module* module, int count) {
+	char* end;
+	long id = std::strtol(key, &end, 10);
+	if (*key && !*end)
+		return id >= 0 && id < count ? id : -1;
+	if (module) {
+		for (int i = 0; i < count; i++) {
+			if (module->paramQuantities[i] && module->paramQuantities[i]->label == key)
+				return i;
+		}
+	}
+	return -1;
+}
+
+bool Patch::load(const std::string& path, plugin::Plugin* plugin) {
+	json_error_t err;
+	json_t* rootJ = json_load_file(path.c_str(), 0, &err);
+	if (!rootJ)
+		return fail(string::f("%s:%d: %s", path.c_str(), err.line, err.text));
+	DEFER({
+		json_decref(rootJ);
+	});
+
+	json_t* sampleRateJ = json_object_get(rootJ, "sampleRate");
+	if (sampleRateJ)
+		sampleRate = json_number_value(sampleRateJ);
+	json_t* bitsJ = json_object_get(rootJ, "bits");
+	if (bitsJ)
+		bits = json_integer_value(bitsJ);
+	if (bits != 16 && bits != 24 && bits != 32)
+		return fail("bits must be 16, 24 or 32");
+	json_t* tailJ = json_object_get(rootJ, "tail");
+	if (tailJ)
+		tail = json_number_value(tailJ);
+
+	json_t* modulesJ = json_object_get(rootJ, "modules");
+	if (!json_array_size(modulesJ))
+		return fail(path + " has no modules");
+	size_t i;
+	json_t* moduleJ;
+	json_array_foreach(modulesJ, i, moduleJ) {
+		const char* slug = json_string_value(json_object_get(moduleJ, "model"));
+		Stage s;
+		for (Model* model : plugin->models) {
+			if (slug && model->slug == slug)
+				s.model = model;
+		}
+		if (!s.model)
+			return fail(string::f("unknown model %s", slug ? slug : "(none)"));
+
+		// An instance to look up the parameter labels and to check the ports
+		Module* module = s.model->createModule();
+		DEFER({
+			delete module;
+		});
+		int numParams = module->params.size();
+		int numInputs = module->inputs.size();
+		int numOutputs = module->outputs.size();
+
+		json_t* inputJ = json_object_get(moduleJ, "input");
+		if (inputJ)
+			s.input = json_integer_value(inputJ);
+		json_t* outputJ = json_object_get(moduleJ, "output");
+		if (outputJ)
+			s.output = json_integer_value(outputJ);
+		if (s.input < 0 || s.input >= numInputs || s.output < 0 || s.output >= numOutputs)
+			return fail(string::f("%s has no such input or output", slug));
+
+		const char* key;
+		json_t* valueJ;
+		json_object_foreach(json_object_get(moduleJ, "params"), key, valueJ) {
+			int id = idOf(key, module, numParams);
+			if (id < 0)
+				return fail(string::f("%s has no parameter %s", slug, key));
+			s.params.push_back(std::make_pair(id, (float)json_number_value(valueJ)));
+		}
+		json_object_foreach(json_object_get(moduleJ, "voltages"), key, valueJ) {
+			int id = idOf(key, NULL, numInputs);
+			if (id < 0 || id == s.input)
+				return fail(string::f("%s has no input %s for a voltage", slug, key));
+			s.voltages.push_back(std::make_pair(id, (float)json_number_value(valueJ)));
+		}
+
+		json_t* dataJ = json_object_get(moduleJ, "data");
+		if (dataJ)
+			s.data = json_incref(dataJ);
+		stages.push_back(s);
+	}
+
+	json_t* jobJ;
+	json_array_foreach(json_object_get(rootJ, "jobs"), i, jobJ) {
+		Job job;
+		const char* input = json_string_value(json_object_get(jobJ, "input"));
+		const char* output = json_string_value(json_object_get(jobJ, "output"));
+		if (input)
+			job.input = input;
+		if (output)
+			job.output = output;
+		job.duration = json_number_value(json_object_get(jobJ, "duration"));
+		if (job.output.empty() || (job.input.empty() && job.duration <= 0.f))
+			return fail(string::f("job %d needs an output and an input or a duration", (int)i));
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+Chain::Chain(const Patch& patch) : patch(patch) {
+	std::lock_guard<std::mutex> lock(domainMutex);
+	for (const Stage& s : patch.stages) {
+		Module* m = s.model->createModule();
+		for (const std::pair<int, float>& p : s.params) {
+			m->params[p.first].setValue(p.second);
+		}
+
+		// Offline there is no deadline, so the spectral modules stay at full
+		// quality unless the patch asks otherwise
+		json_t* dataJ = json_object();
+		json_object_set_new(dataJ, "qualityFloor", json_integer(0));
+		if (s.data)
+			json_object_update(dataJ, s.data);
+		m->dataFromJson(dataJ);
+		json_decref(dataJ);
+
+		for (const std::pair<int, float>& v : s.voltages) {
+			m->inputs[v.first].channels = 1;
+			m->inputs[v.first].setVoltage(v.second);
+		}
+		// As if a cable was plugged into the output
+		m->outputs[s.output].channels = 1;
+		modules.push_back(m);
+	}
+	args.sampleRate = patch.sampleRate;
+	args.sampleTime = 1.f / patch.sampleRate;
+}
+
+Chain::~Chain() {
+	std::lock_guard<std::mutex> lock(domainMutex);
+	for (Module* m : modules) {
+		delete m;
+	}
+}
+
+int Chain::process(const float* in, int inChannels, float* out) {
+	const float* src = in;
+	int channels = inChannels;
+	float scale = VOLTS;
+	for (size_t i = 0; i < modules.size(); i++) {
+		Module* m = modules[i];
+		// A generator at the start of the chain keeps its input unpatched
+		if (channels > 0) {
+			Input& input = m->inputs[patch.stages[i].input];
+			input.channels = channels;
+			for (int c = 0; c < channels; c++) {
+				input.voltages[c] = src[c] * scale;
+			}
+		}
+		m->process(args);
+		Output& output = m->outputs[patch.stages[i].output];
+		src = output.voltages;
+		channels = output.channels;
+		scale = 1.f;
+	}
+	for (int c = 0; c < channels; c++) {
+		out[c] = src[c] / VOLTS;
+	}
+	return channels;
+}
+
+bool render(const Patch& patch, const Job& job, std::string& error) {
+	Wav::Reader reader;
+	int inChannels = 0;
+	if (!job.input.empty()) {
+		if (!reader.open(job.input)) {
+			error = reader.error;
+			return false;
+		}
+		if (reader.sampleRate != (int)patch.sampleRate) {
+			error = string::f("%s is at %d Hz, the batch renders at %g Hz", job.input.c_str(), reader.sampleRate, patch.sampleRate);
+			return false;
+		}
+		if (reader.channels > PORT_MAX_CHANNELS) {
+			error = string::f("%s has more than %d channels", job.input.c_str(), PORT_MAX_CHANNELS);
+			return false;
+		}
+		inChannels = reader.channels;
+	}
+	int64_t length = job.duration * patch.sampleRate;
+	int64_t tail = patch.tail * patch.sampleRate;
+
+	Chain chain(patch);
+	Wav::Writer writer;
+	// The output has as many channels as the chain had on its first frame
+	int outChannels = 0;
+	std::vector<float> in(BLOCK * std::max(inChannels, 1));
+	std::vector<float> out(BLOCK * PORT_MAX_CHANNELS);
+	float frame[PORT_MAX_CHANNELS];
+	bool inputDone = false;
+
+	while (true) {
+		int n = 0;
+		if (!inputDone) {
+			if (inChannels > 0) {
+				n = reader.read(in.data(), BLOCK);
+			}
+			else {
+				n = (int)std::min<int64_t>(BLOCK, length);
+				length -= n;
+			}
+			inputDone = n == 0;
+		}
+		if (inputDone) {
+			n = (int)std::min<int64_t>(BLOCK, tail);
+			tail -= n;
+			if (n == 0)
+				break;
+			std::fill(in.begin(), in.end(), 0.f);
+		}
+
+		for (int i = 0; i < n; i++) {
+			int channels = chain.process(&in[i * inChannels], inChannels, frame);
+			if (outChannels == 0) {
+				outChannels = std::max(channels, 1);
+				if (!writer.open(job.output, outChannels, (int)patch.sampleRate, patch.bits)) {
+					error = writer.error;
+					return false;
+				}
+			}
+			for (int c = 0; c < outChannels; c++) {
+				out[i * outChannels + c] = c < channels ? frame[c] : 0.f;
+			}
+		}
+		if (!writer.write(out.data(), n)) {
+			error = "cannot write " + job.output;
+			return false;
+		}
+	}
+
+	if (outChannels == 0) {
+		error = "nothing to render for " + job.output;
+		return false;
+	}
+	if (!writer.close()) {
+		error = writer.error + " in " + job.output;
+		return false;
+	}
+	return true;
+}
+
+} // namespace Render
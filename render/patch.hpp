@@ -0,0 +1,68 @@
+#pragma once
+#include "plugin.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * A chain of modules and the files to render through it. The signal enters
+ * the first module, each output feeds the input of the next module, and the
+ * output of the last module is written to the file.
+ */
+namespace Render {
+
+/** Full scale of the files in volts, as for Rack's audio interfaces */
+static const float VOLTS = 5.f;
+
+struct Stage {
+	Model* model = NULL;
+	int input = 0;
+	int output = 0;
+	/** Parameter values, as stored in a Rack patch */
+	std::vector<std::pair<int, float>> params;
+	/** Constant voltages on inputs other than the signal input */
+	std::vector<std::pair<int, float>> voltages;
+	/** Passed to dataFromJson(), owned by the patch */
+	json_t* data = NULL;
+};
+
+struct Job {
+	/** Empty for modules that generate the signal */
+	std::string input;
+	std::string output;
+	/** Seconds to render when there is no input file */
+	float duration = 0.f;
+};
+
+struct Patch {
+	float sampleRate = 0.f;
+	/** Sample format of the output files, 16 or 24 for integer, 32 for float */
+	int bits = 32;
+	/** Seconds of silence fed after the input, for the latency and decay of the chain */
+	float tail = 0.f;
+	std::vector<Stage> stages;
+	std::vector<Job> jobs;
+	std::string error;
+
+	~Patch();
+	bool load(const std::string& path, plugin::Plugin* plugin);
+
+private:
+	bool fail(const std::string& message);
+};
+
+/** Module instances of one patch, one chain per worker thread */
+struct Chain {
+	const Patch& patch;
+	std::vector<Module*> modules;
+	Module::ProcessArgs args;
+
+	Chain(const Patch& patch);
+	~Chain();
+	/** Processes one frame of inChannels samples, returns the number of channels written to out */
+	int process(const float* in, int inChannels, float* out);
+};
+
+/** Renders one job, returns false and sets error if it failed */
+bool render(const Patch& patch, const Job& job, std::string& error);
+
+} // namespace Render
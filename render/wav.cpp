@@ -0,0 +1,208 @@
+#include "wav.hpp"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace Wav {
+
+static uint16_t u16(const uint8_t* p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t u32(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+static void put16(uint8_t* p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+Reader::~Reader() {
+	if (file)
+		std::fclose(file);
+}
+
+bool Reader::fail(const std::string& message) {
+	error = message;
+	return false;
+}
+
+bool Reader::open(const std::string& path) {
+	file = std::fopen(path.c_str(), "rb");
+	if (!file)
+		return fail("cannot open " + path);
+
+	uint8_t riff[12];
+	if (std::fread(riff, 1, 12, file) != 12 || std::memcmp(riff, "RIFF", 4) || std::memcmp(riff + 8, "WAVE", 4))
+		return fail(path + " is not a WAV file");
+
+	// Walk the chunks up to the samples, anything after them is ignored
+	bool fmt = false;
+	while (true) {
+		uint8_t chunk[8];
+		if (std::fread(chunk, 1, 8, file) != 8)
+			return fail(path + " has no data chunk");
+		uint32_t size = u32(chunk + 4);
+
+		if (!std::memcmp(chunk, "fmt ", 4)) {
+			uint8_t f[40] = {};
+			uint32_t n = std::min(size, 40u);
+			if (n < 16 || std::fread(f, 1, n, file) != n)
+				return fail(path + " has a broken fmt chunk");
+			uint16_t tag = u16(f);
+			channels = u16(f + 2);
+			sampleRate = u32(f + 4);
+			bits = u16(f + 14);
+			// WAVE_FORMAT_EXTENSIBLE keeps the actual format in its sub format
+			if (tag == 0xfffe && n >= 26)
+				tag = u16(f + 24);
+			floating = tag == 3;
+			if (!((tag == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32)) || (floating && bits == 32)))
+				return fail(path + " has an unsupported sample format");
+			if (channels < 1)
+				return fail(path + " has no channels");
+			fmt = true;
+			if (std::fseek(file, size - n + (size & 1), SEEK_CUR))
+				return fail(path + " is truncated");
+		}
+		else if (!std::memcmp(chunk, "data", 4)) {
+			if (!fmt)
+				return fail(path + " has no fmt chunk");
+			// Streaming writers leave the size at 0 or all ones
+			remaining = (size == 0 || size == 0xffffffff) ? -1 : size / (channels * bits / 8);
+			return true;
+		}
+		else if (std::fseek(file, size + (size & 1), SEEK_CUR)) {
+			return fail(path + " is truncated");
+		}
+	}
+}
+
+int Reader::read(float* dst, int n) {
+	if (remaining >= 0)
+		n = (int)std::min<int64_t>(n, remaining);
+	int frameBytes = channels * bits / 8;
+	raw.resize(n * frameBytes);
+	int frames = std::fread(raw.data(), frameBytes, n, file);
+	if (remaining >= 0)
+		remaining -= frames;
+
+	int samples = frames * channels;
+	const uint8_t* p = raw.data();
+	switch (bits) {
+		case 8:
+			for (int i = 0; i < samples; i++) {
+				dst[i] = (int(p[i]) - 128) / 128.f;
+			}
+			break;
+		case 16:
+			for (int i = 0; i < samples; i++, p += 2) {
+				dst[i] = int16_t(u16(p)) / 32768.f;
+			}
+			break;
+		case 24:
+			for (int i = 0; i < samples; i++, p += 3) {
+				int32_t v = int32_t(uint32_t(p[0] << 8) | (p[1] << 16) | (uint32_t(p[2]) << 24)) >> 8;
+				dst[i] = v / 8388608.f;
+			}
+			break;
+		case 32:
+			for (int i = 0; i < samples; i++, p += 4) {
+				uint32_t v = u32(p);
+				if (floating)
+					std::memcpy(&dst[i], &v, 4);
+				else
+					dst[i] = int32_t(v) / 2147483648.f;
+			}
+			break;
+	}
+	return frames;
+}
+
+Writer::~Writer() {
+	if (file)
+		std::fclose(file);
+}
+
+bool Writer::open(const std::string& path, int channels, int sampleRate, int bits) {
+	this->channels = channels;
+	this->bits = bits;
+	file = std::fopen(path.c_str(), "wb");
+	if (!file) {
+		error = "cannot create " + path;
+		return false;
+	}
+
+	// The sizes are filled in by close()
+	uint8_t h[44];
+	std::memcpy(h, "RIFF", 4);
+	put32(h + 4, 0);
+	std::memcpy(h + 8, "WAVEfmt ", 8);
+	put32(h + 16, 16);
+	put16(h + 20, bits == 32 ? 3 : 1);
+	put16(h + 22, channels);
+	put32(h + 24, sampleRate);
+	put32(h + 28, sampleRate * channels * bits / 8);
+	put16(h + 32, channels * bits / 8);
+	put16(h + 34, bits);
+	std::memcpy(h + 36, "data", 4);
+	put32(h + 40, 0);
+	std::fwrite(h, 1, 44, file);
+	return true;
+}
+
+bool Writer::write(const float* src, int n) {
+	int samples = n * channels;
+	raw.resize(samples * bits / 8);
+	uint8_t* p = raw.data();
+	switch (bits) {
+		case 16:
+			for (int i = 0; i < samples; i++, p += 2) {
+				float x = std::min(std::max(src[i], -1.f), 1.f);
+				put16(p, uint16_t(int16_t(std::lround(x * 32767.f))));
+			}
+			break;
+		case 24:
+			for (int i = 0; i < samples; i++, p += 3) {
+				float x = std::min(std::max(src[i], -1.f), 1.f);
+				uint32_t v = uint32_t(int32_t(std::lround(x * 8388607.f)));
+				p[0] = v;
+				p[1] = v >> 8;
+				p[2] = v >> 16;
+			}
+			break;
+		case 32:
+			std::memcpy(p, src, samples * 4);
+			break;
+	}
+	dataBytes += raw.size();
+	return std::fwrite(raw.data(), 1, raw.size(), file) == raw.size();
+}
+
+bool Writer::close() {
+	if (dataBytes & 1)
+		std::fputc(0, file);
+	uint8_t size[4];
+	put32(size, 36 + dataBytes + (dataBytes & 1));
+	std::fseek(file, 4, SEEK_SET);
+	std::fwrite(size, 1, 4, file);
+	put32(size, dataBytes);
+	std::fseek(file, 40, SEEK_SET);
+	std::fwrite(size, 1, 4, file);
+	bool ok = !std::ferror(file);
+	ok = std::fclose(file) == 0 && ok;
+	file = NULL;
+	if (!ok)
+		error = "write error";
+	return ok;
+}
+
+} // namespace Wav
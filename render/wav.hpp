@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Streaming WAV files for the offline renderer. Samples are interleaved
+ * floats in -1..1, files are read and written block by block and are never
+ * held in memory as a whole.
+ */
+namespace Wav {
+
+struct Reader {
+	int channels = 0;
+	int sampleRate = 0;
+	int bits = 0;
+	bool floating = false;
+	/** Frames left in the data chunk, -1 if the size is unknown and the file is read to its end */
+	int64_t remaining = -1;
+	std::string error;
+
+	~Reader();
+	bool open(const std::string& path);
+	/** Reads up to n frames into dst, returns the number of frames read, 0 at the end */
+	int read(float* dst, int n);
+
+private:
+	FILE* file = NULL;
+	std::vector<uint8_t> raw;
+
+	bool fail(const std::string& message);
+};
+
+struct Writer {
+	std::string error;
+
+	~Writer();
+	/** bits is 16 or 24 for integer samples, 32 for float samples */
+	bool open(const std::string& path, int channels, int sampleRate, int bits);
+	bool write(const float* src, int n);
+	/** Completes the header, returns false if anything went wrong while writing */
+	bool close();
+
+private:
+	FILE* file = NULL;
+	int channels = 0;
+	int bits = 0;
+	uint32_t dataBytes = 0;
+	std::vector<uint8_t> raw;
+};
+
+} // namespace Wav
@@ -1,4 +1,8 @@
 #include "plugin.hpp"
+#include "cv.hpp"
+#include "control.hpp"
+#include "trace.hpp"
+#include "dispatch.hpp"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsuggest-override"
@@ -9,6 +13,43 @@
 
 namespace BitMk1 {
 
+enum Mode {
+	QUANTIZER,
+	INTEGER,
+	NUM_MODES
+};
+
+static const char* const MODE_LABELS[NUM_MODES] = {
+	"Quantizer",
+	"Integer"
+};
+
+/**
+ * Fixed-point crush of all channels, 24 bit samples truncated by integer
+ * masks, the kernel runs in the variant for the CPU, see dispatch.hpp
+ */
+struct IntegerCrusher {
+	/** xorshift32 state of each channel */
+	int32_t noise[PORT_MAX_CHANNELS];
+	/** Last crushed sample of each channel in -1..1 */
+	float held[PORT_MAX_CHANNELS] = {};
+
+	IntegerCrusher() {
+		for (int i = 0; i < PORT_MAX_CHANNELS; i++) {
+			noise[i] = (int32_t)((i + 1) * 0x9e3779b9u);
+		}
+	}
+
+	/** Converts c channels of the input to bits of resolution, with triangular dither of one LSB */
+	void process(Input& input, int c, int bits, bool dither) {
+		float x[PORT_MAX_CHANNELS] = {};
+		for (int i = 0; i < c; i++) {
+			x[i] = input.getVoltage(i) / 10.f;
+		}
+		Dispatch::kernels.crush(x, held, noise, c, bits, dither);
+	}
+};
+
 struct BitMk1Module : Module {
 	enum ParamIds {
 		FREQ_PARAM,
@@ -32,6 +73,18 @@ struct BitMk1Module : Module {
 	};
 
 	gam::Quantizer<> qnt[PORT_MAX_CHANNELS];	// Quantization modulator
+	IntegerCrusher crusher;
+	int holdPhase = 0;
+	int mode;
+	bool dither;
+	Cv::ConvexCache<> freqTaper;
+	Cv::ConcaveCache<> stepTaper;
+	Control::LinearRamp<> freqRamp;
+	Control::LinearRamp<> stepRamp;
+	int channels = 0;
+
+	Control::Divider controlDivider;
+	Control::Settings control;
 
 	BitMk1Module() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -40,31 +93,109 @@ struct BitMk1Module : Module {
 		configParam(STEP_PARAM, 0.f, 1.f, 1.f);
 		configParam(STEPTAPER_PARAM, 0.f, 1.f, 1.f);
 		onReset();
+		onSampleRateChange();
+		controlDivider.setDivision(Control::DIVISION);
+	}
+
+	void onReset() override {
+		mode = QUANTIZER;
+		dither = false;
+	}
+
+	void onSampleRateChange() override {
+		gam::Domain::master().spu(APP->engine->getSampleRate());
+	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		json_object_set_new(rootJ, "mode", json_integer(mode));
+		json_object_set_new(rootJ, "dither", json_boolean(dither));
+		control.dataToJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		json_t* modeJ = json_object_get(rootJ, "mode");
+		if (modeJ)
+			mode = clamp((int)json_integer_value(modeJ), 0, NUM_MODES - 1);
+		json_t* ditherJ = json_object_get(rootJ, "dither");
+		if (ditherJ)
+			dither = json_boolean_value(ditherJ);
+		control.dataFromJson(rootJ);
 	}
 
 	void process(const ProcessArgs &args) override {
-		gam::Domain::master().spu(args.sampleRate);
+		TRACE_ZONE("Bit Mk1");
 		int c = inputs[INPUT].getChannels();
 		outputs[OUTPUT].setChannels(c);
 
 		if (c > 0) {
-			float freqParam = params[FREQ_PARAM].getValue();
-			float freq = inputs[FREQ_INPUT].isConnected() ? inputs[FREQ_INPUT].getVoltage() * freqParam / 10.f : freqParam;
-			if (params[FREQTAPER_PARAM].getValue() == 1.f)
-				freq = args.sampleRate * (1.f - powf(1.f - freq, 0.5f));
-			else
-				freq = args.sampleRate * freq;
-			
-			float stepParam = params[STEP_PARAM].getValue();
-			float step = inputs[STEP_INPUT].isConnected() ? inputs[STEP_INPUT].getVoltage() * stepParam / 10.f : stepParam;
-			if (params[STEPTAPER_PARAM].getValue() == 1.f)
-				step = 1.f - powf(step, 0.5f);
-			else
-				step = 1.f - step;
+			bool update = c != channels;
+			channels = c;
+
+			control.update(controlDivider);
+			bool evaluate = controlDivider.process();
+			bool freqAudio = control.isAudioRate(FREQ_INPUT) && inputs[FREQ_INPUT].isConnected();
+			bool stepAudio = control.isAudioRate(STEP_INPUT) && inputs[STEP_INPUT].isConnected();
+
+			if (evaluate || freqAudio) {
+				float freqParam = params[FREQ_PARAM].getValue();
+				float freq = inputs[FREQ_INPUT].isConnected() ? inputs[FREQ_INPUT].getVoltage() * freqParam / 10.f : freqParam;
+				// Negative or excess CV would take the tapers' square roots out of range
+				freq = clamp(freq, 0.f, 1.f);
+				if (params[FREQTAPER_PARAM].getValue() == 1.f)
+					freq = args.sampleRate * freqTaper(freq);
+				else
+					freq = args.sampleRate * freq;
+				if (freqAudio)
+					update |= freqRamp.jump(freq);
+				else
+					freqRamp.setTarget(freq, controlDivider.getDivision());
+			}
+
+			if (evaluate || stepAudio) {
+				float stepParam = params[STEP_PARAM].getValue();
+				float step = inputs[STEP_INPUT].isConnected() ? inputs[STEP_INPUT].getVoltage() * stepParam / 10.f : stepParam;
+				step = clamp(step, 0.f, 1.f);
+				if (params[STEPTAPER_PARAM].getValue() == 1.f)
+					step = 1.f - stepTaper(step);
+				else
+					step = 1.f - step;
+				if (stepAudio)
+					update |= stepRamp.jump(step);
+				else
+					stepRamp.setTarget(step, controlDivider.getDivision());
+			}
+			update |= evaluate;
+
+			update |= freqRamp.isRamping() || stepRamp.isRamping();
+			float freq = freqRamp.process();
+			float step = stepRamp.process();
+
+			if (mode == INTEGER) {
+				// Sample rate reduction by holding whole samples, 1 to 24 bits from the step
+				// NaN fails both comparisons and ends up at the lowest rate and depth
+				float f = freq >= 1.f ? freq : 1.f;
+				int hold = std::max((int)std::round(args.sampleRate / f), 1);
+				float depth = step <= 1.f ? 1.f - step : 0.f;
+				int bits = clamp(1 + (int)std::round(23.f * clamp(depth, 0.f, 1.f)), 1, 24);
+				bool sample = ++holdPhase >= hold;
+				if (sample)
+					holdPhase = 0;
+
+				if (sample)
+					crusher.process(inputs[INPUT], c, bits, dither);
+				for (int i = 0; i < c; i++) {
+					outputs[OUTPUT].setVoltage(crusher.held[i] * 10.f, i);
+				}
+				return;
+			}
 
 			for (int i = 0; i < c; i++) {
-				qnt[i].freq(freq);		// Set sample rate quantization
-				qnt[i].step(step);		// Set amplitude quantization
+				if (update) {
+					qnt[i].freq(freq);		// Set sample rate quantization
+					qnt[i].step(step);		// Set amplitude quantization
+				}
 
 				float s = rescale(inputs[INPUT].getVoltage(i), -10.f, 10.f, -1.f, 1.f);
 				s = qnt[i](s);			// Apply the bitcrush
@@ -75,6 +206,33 @@ struct BitMk1Module : Module {
 	}
 };
 
+struct ModeItem : MenuItem {
+	BitMk1Module* module;
+	int mode;
+
+	void onAction(const event::Action& e) override {
+		module->mode = mode;
+	}
+
+	void step() override {
+		rightText = CHECKMARK(module->mode == mode);
+		MenuItem::step();
+	}
+};
+
+struct DitherItem : MenuItem {
+	BitMk1Module* module;
+
+	void onAction(const event::Action& e) override {
+		module->dither ^= true;
+	}
+
+	void step() override {
+		rightText = CHECKMARK(module->dither);
+		MenuItem::step();
+	}
+};
+
 struct BitMk1Widget : ModuleWidget {
 	BitMk1Widget(BitMk1Module* module) {
 		setModule(module);
@@ -94,6 +252,18 @@ struct BitMk1Widget : ModuleWidget {
 		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 278.4f), module, BitMk1Module::INPUT));
 		addOutput(createOutputCentered<StoermelderPort>(Vec(22.5f, 323.8f), module, BitMk1Module::OUTPUT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		BitMk1Module* module = dynamic_cast<BitMk1Module*>(this->module);
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createMenuLabel("Mode"));
+		for (int i = 0; i < NUM_MODES; i++) {
+			menu->addChild(construct<ModeItem>(&MenuItem::text, MODE_LABELS[i], &ModeItem::module, module, &ModeItem::mode, i));
+		}
+		menu->addChild(construct<DitherItem>(&MenuItem::text, "Dither in integer mode", &DitherItem::module, module));
+		Control::appendContextMenu(menu, &module->control, {{BitMk1Module::FREQ_INPUT, "Frequency"}, {BitMk1Module::STEP_INPUT, "Step"}});
+		Trace::appendContextMenu(menu);
+	}
 };
 
 } // namespace BitMk1
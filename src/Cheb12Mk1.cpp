@@ -1,4 +1,7 @@
 #include "plugin.hpp"
+#include "cv.hpp"
+#include "control.hpp"
+#include "trace.hpp"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsuggest-override"
@@ -39,8 +42,17 @@ struct Cheb12Mk1Module : Module {
 
 	gam::Sine<> osc[8];			// Source sine
 	gam::ChebyN<12> cheby[8];	// Chebyshev waveshaper with 12 harmonics
-	float cvs[8] = {};
+	Cv::VoctCache<simd::float_4> freq[2];
+	float vol[8];
 
+	Control::LinearRamp<simd::float_4> harmRamp[3];
+	Control::LinearRamp<> freqRamp;
+	Control::LinearRamp<> detuneRamp;
+	int rotParam = 0;
+	int channels = 0;
+
+	Control::Divider controlDivider;
+	Control::Settings control;
 	dsp::ClockDivider lightDivider;
 
 	Cheb12Mk1Module() {
@@ -53,45 +65,104 @@ struct Cheb12Mk1Module : Module {
 		configParam(ROT_PARAM, -12.f, 12.f, 0.f, "Rotate harmonics per voice");
 		configParam(DETUNE_PARAM, -1.f, 1.f, 0.f, "Detune");
 		onReset();
+		onSampleRateChange();
+		controlDivider.setDivision(Control::DIVISION);
 		lightDivider.setDivision(1024);
 	}
 
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		control.dataToJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		control.dataFromJson(rootJ);
+	}
+
+	void onSampleRateChange() override {
+		gam::Domain::master().spu(APP->engine->getSampleRate());
+	}
+
 	void process(const ProcessArgs &args) override {
-		gam::Domain::master().spu(args.sampleRate);
+		TRACE_ZONE("Cheb12 Mk1");
 		int c = std::min(std::max(inputs[VOCT_INPUT].getChannels(), 1), 8);
 		outputs[OUTPUT].setChannels(c);
 
-		float freqParam = params[FREQ_PARAM].getValue() / 12.f;
-		freqParam += params[OCT_PARAM].getValue();
-		freqParam += dsp::quadraticBipolar(params[FINE_PARAM].getValue()) * 3.f / 12.f;
+		// Rebuild the waveshaper coefficients only if harmonics, rotation or channels changed
+		bool coefUpdate = c != channels;
+		channels = c;
+
+		control.update(controlDivider);
+		bool evaluate = controlDivider.process();
+		// The harmonic inputs share the flag of the first one
+		bool detuneAudio = control.isAudioRate(DETUNE_INPUT) && inputs[DETUNE_INPUT].isConnected();
+		bool harmAudio = control.isAudioRate(HARM_INPUT);
+
+		if (evaluate) {
+			float freqParam = params[FREQ_PARAM].getValue() / 12.f;
+			freqParam += params[OCT_PARAM].getValue();
+			freqParam += dsp::quadraticBipolar(params[FINE_PARAM].getValue()) * 3.f / 12.f;
+			freqRamp.setTarget(freqParam, controlDivider.getDivision());
 
-		int rotParam = inputs[ROT_INPUT].isConnected() ? int(std::floor(inputs[ROT_INPUT].getVoltage() / 0.833f)) : params[ROT_PARAM].getValue();
+			int rot = inputs[ROT_INPUT].isConnected() ? int(std::floor(inputs[ROT_INPUT].getVoltage() / 0.833f)) : params[ROT_PARAM].getValue();
+			coefUpdate |= rot != rotParam;
+			rotParam = rot;
+		}
 
-		float detuneParam = params[DETUNE_PARAM].getValue();
-		float detune = inputs[DETUNE_INPUT].isConnected() ? inputs[DETUNE_INPUT].getVoltage() / 5.f * detuneParam : detuneParam;
-		detune = dsp::quadraticBipolar(detuneParam) * 3.f / 12.f;
+		if (evaluate || detuneAudio) {
+			float detuneParam = params[DETUNE_PARAM].getValue();
+			float detune = inputs[DETUNE_INPUT].isConnected() ? inputs[DETUNE_INPUT].getVoltage() / 5.f * detuneParam : detuneParam;
+			detune = dsp::quadraticBipolar(clamp(detune, -1.f, 1.f)) * 3.f / 12.f;
+			if (detuneAudio)
+				detuneRamp.jump(detune);
+			else
+				detuneRamp.setTarget(detune, controlDivider.getDivision());
+		}
+
+		if (evaluate || harmAudio) {
+			for (int k = 0; k < 3; k++) {
+				simd::float_4 harm;
+				for (int j = 0; j < 4; j++) {
+					int h = k * 4 + j;
+					float harmParam = params[HARM_PARAM + h].getValue();
+					harm[j] = inputs[HARM_INPUT + h].isConnected() ? inputs[HARM_INPUT + h].getVoltage() / 10.f * harmParam : harmParam;
+				}
+				if (harmAudio)
+					coefUpdate |= harmRamp[k].jump(harm);
+				else
+					harmRamp[k].setTarget(harm, controlDivider.getDivision());
+			}
+		}
+
+		float freqParam = freqRamp.process();
+		float detune = detuneRamp.process();
 
 		float harm[12];
-		for (int k = 0; k < 12; k++) {
-			float harmParam = params[HARM_PARAM + k].getValue();
-			harm[k] = inputs[HARM_INPUT + k].isConnected() ? inputs[HARM_INPUT + k].getVoltage() / 10.f * harmParam : harmParam;
+		for (int k = 0; k < 3; k++) {
+			coefUpdate |= harmRamp[k].isRamping();
+			harmRamp[k].process().store(&harm[k * 4]);
 		}
 
-		int rot = 0;
 		for (int i = 0; i < c; i++) {
-			float vol = 0.f;
-			for (int k = 0; k < 12; k++) {
-				// Set amplitude of kth harmonic
-				cheby[i].coef(k) = harm[(k - rot + 60) % 12];
-				vol += cheby[i].coef(k);
+			if (coefUpdate) {
+				int rot = (i * rotParam) % 12;
+				vol[i] = 0.f;
+				for (int k = 0; k < 12; k++) {
+					// Set amplitude of kth harmonic
+					cheby[i].coef(k) = harm[(k - rot + 12) % 12];
+					vol[i] += cheby[i].coef(k);
+				}
 			}
 
-			float pitch = freqParam + (detune * i) + inputs[VOCT_INPUT].getVoltage(i);
-			if (pitch != cvs[i]) {
-				cvs[i] = pitch;
-				//float freq = dsp::FREQ_C4 * dsp::approxExp2_taylor5(pitch + 30) / 1073741824;
-				float freq = dsp::FREQ_C4 * powf(2.0, pitch);
-				osc[i].freq(freq);
+			if (i % 4 == 0) {
+				simd::float_4 voice = simd::float_4(i, i + 1, i + 2, i + 3);
+				simd::float_4 pitch = freqParam + detune * voice + inputs[VOCT_INPUT].getVoltageSimd<simd::float_4>(i);
+				if (freq[i / 4].process(pitch)) {
+					// Inactive oscillators of the lane too, the cache holds all four
+					for (int j = i; j < i + 4; j++)
+						osc[j].freq(freq[i / 4].out[j - i]);
+				}
 			}
 
 			float s = osc[i]();
@@ -100,12 +171,10 @@ struct Cheb12Mk1Module : Module {
 			s = cheby[i](s);
 
 			// Divide by number of harmonics to prevent clipping
-			s /= vol;
+			s /= vol[i];
 
 			float o = rescale(s, -1.f, 1.f, -5.f, 5.f);
 			outputs[OUTPUT].setVoltage(o, i);
-
-			rot += rotParam;
 		}
 
 		// Set channel lights infrequently
@@ -181,6 +250,12 @@ struct Cheb12Mk1Widget : ModuleWidget {
 		addInput(createInputCentered<StoermelderPort>(Vec(20.8f, 323.8f), module, Cheb12Mk1Module::VOCT_INPUT));
 		addOutput(createOutputCentered<StoermelderPort>(Vec(158.5f, 323.8f), module, Cheb12Mk1Module::OUTPUT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Cheb12Mk1Module* module = dynamic_cast<Cheb12Mk1Module*>(this->module);
+		Control::appendContextMenu(menu, &module->control, {{Cheb12Mk1Module::HARM_INPUT, "Harmonic"}, {Cheb12Mk1Module::DETUNE_INPUT, "Detune"}});
+		Trace::appendContextMenu(menu);
+	}
 };
 
 } // namespace Cheb12Mk1
@@ -1,4 +1,5 @@
 #include "plugin.hpp"
+#include "trace.hpp"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsuggest-override"
@@ -36,22 +37,33 @@ struct DecayMk1Module : Module {
 		configParam(DECAY_PARAM, 0.1f, 60.f, 10.f, "Decay time in seconds");
 		configParam(AMP_PARAM, 0.f, 10.f, 10.f, "Start voltage", "V");
 		onReset();
+		onSampleRateChange();
+	}
+
+	void onSampleRateChange() override {
+		gam::Domain::master().spu(APP->engine->getSampleRate());
 	}
 
 	void process(const ProcessArgs &args) override {
-		gam::Domain::master().spu(args.sampleRate);
+		TRACE_ZONE("Decay Mk1");
 		int c = inputs[GATE_INPUT].getChannels();
 		outputs[ENV_OUTPUT].setChannels(c);
 
 		if (c > 0) {
-			float ampParam = params[AMP_PARAM].getValue();
-			float amp = inputs[AMP_INPUT].isConnected() ? inputs[AMP_INPUT].getVoltage() * ampParam / 10.f : ampParam;
-
-			float decayParam = params[DECAY_PARAM].getValue();
-			float decay = inputs[DECAY_INPUT].isConnected() ? inputs[DECAY_INPUT].getVoltage() * decayParam / 10.f : decayParam;
+			// Knobs and CV are only needed on a trigger, evaluate them at most once per sample
+			bool evaluated = false;
+			float amp = 0.f;
+			float decay = 0.f;
 
 			for (int i = 0; i < c; i++) {
 				if (gateTrigger[i].process(inputs[GATE_INPUT].getVoltage(i))) {
+					if (!evaluated) {
+						float ampParam = params[AMP_PARAM].getValue();
+						amp = inputs[AMP_INPUT].isConnected() ? inputs[AMP_INPUT].getVoltage() * ampParam / 10.f : ampParam;
+						float decayParam = params[DECAY_PARAM].getValue();
+						decay = inputs[DECAY_INPUT].isConnected() ? inputs[DECAY_INPUT].getVoltage() * decayParam / 10.f : decayParam;
+						evaluated = true;
+					}
 					env[i].decay(decay);	// Set decay length in seconds
 					env[i].reset(amp);		// Reset envelope and specify amplitude
 				}
@@ -79,6 +91,10 @@ struct DecayMk1Widget : ModuleWidget {
 		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 280.6f), module, DecayMk1Module::GATE_INPUT));
 		addOutput(createOutputCentered<StoermelderPort>(Vec(22.5f, 323.8f), module, DecayMk1Module::ENV_OUTPUT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Trace::appendContextMenu(menu);
+	}
 };
 
 } // namespace Decay
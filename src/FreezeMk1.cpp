@@ -1,4 +1,5 @@
 #include "plugin.hpp"
+#include "trace.hpp"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsuggest-override"
@@ -45,11 +46,15 @@ struct FreezeMk1 : Module {
 
 		//stft1.precise(true);
         onReset();
+		onSampleRateChange();
+	}
+
+	void onSampleRateChange() override {
+		gam::Domain::master().spu(APP->engine->getSampleRate());
 	}
 
   	void process(const ProcessArgs &args) override {
-        gam::Domain::master().spu(args.sampleRate);
-		
+        TRACE_ZONE("Freeze Mk1");
         float s = inputs[SRC_INPUT].getVoltage();
         s = rescale(s, -5.f, 5.f, -0.8f, 0.8f);
 
@@ -92,6 +97,10 @@ struct FreezeMk1Widget : ModuleWidget {
 
 		addParam(createParamCentered<RoundBlackSnapKnob>(mm2px(Vec(18.5f, 51.f)), module, FreezeMk1::HOP_PARAM));
     }
+
+	void appendContextMenu(Menu* menu) override {
+		Trace::appendContextMenu(menu);
+	}
 };
 
 Model *modelFreezeMk1 = createModel<FreezeMk1, FreezeMk1Widget>("FreezeMk1");
\ No newline at end of file
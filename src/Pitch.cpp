@@ -1,4 +1,9 @@
 #include "plugin.hpp"
+#include "cv.hpp"
+#include "spectrum.hpp"
+#include "spectral.hpp"
+#include "trace.hpp"
+#include "quality.hpp"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsuggest-override"
@@ -28,15 +33,22 @@ struct PitchModule : Module {
 		NUM_LIGHTS
 	};
 
+	/**
+	 * Stays at a fixed hop, gam::STFT::sizeHop() is not known to be free of
+	 * allocations on the audio thread. The quality scheduler lowers the hop
+	 * once Pitch has moved onto Fft::Stft, its frames still count to the load.
+	 */
 	gam::STFT stft;
+	Spectrum::Publisher spectrum;
 
 	PitchModule() :
 		// STFT(winSize, hopSize, padSize, winType, sampType, auxBufs)
-		stft(4096, 4096/4, 0, gam::HAMMING, gam::MAG_FREQ, 3)
+		stft(4096, 4096/4, 0, gam::HAMMING, gam::MAG_FREQ, 5)
 	{
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(PARAM_SHIFT, -3.f, 3.f, 0.f, "Pitch shift");
 		onReset();
+		onSampleRateChange();
 		stft.precise(true);
 	}
 
@@ -45,33 +57,35 @@ struct PitchModule : Module {
 	}
 
 	void process(const ProcessArgs &args) override {
+		TRACE_ZONE("Pitch");
+		Quality::Timer timer;
 		if (inputs[INPUT].isConnected()) {
-			float pshift = std::exp2(params[PARAM_SHIFT].getValue() + inputs[INPUT_SHIFT].getVoltage());
 			float s = inputs[INPUT].getVoltage();
 
 			if (stft(s)){
+				TRACE_ZONE("Pitch frame");
+				timer.begin();
+
 				enum {
 					PREV_MAG=0,
 					TEMP_MAG,
-					TEMP_FRQ
+					TEMP_FRQ,
+					IN_MAG,
+					IN_FRQ
 				};
 
+				unsigned n = stft.numBins();
+				float* bins = &stft.bin(0)[0];
+				Spectral::deinterleave(bins, stft.aux(IN_MAG), stft.aux(IN_FRQ), n);
+
 				// Compute spectral flux (L^1 norm on positive changes)
-				float flux = 0;
-				for (unsigned k=0; k<stft.numBins(); ++k){
-					float mcurr = stft.bin(k)[0];
-					float mprev = stft.aux(PREV_MAG)[k];
-
-					if (mcurr > mprev){
-						flux += mcurr - mprev;
-					}
-				}
+				float flux = Spectral::flux(stft.aux(IN_MAG), stft.aux(PREV_MAG), n);
 
 				//printf("%g\n", flux);
 				//gam::printPlot(flux); printf("\n");
 
 				// Store magnitudes for next frame
-				stft.copyBinsToAux(0, PREV_MAG);
+				Spectral::copy(stft.aux(PREV_MAG), stft.aux(IN_MAG), n);
 
 				// Given an onset, we would like the phases of the output frame
 				// to match the input frame in order to preserve transients.
@@ -80,29 +94,36 @@ struct PitchModule : Module {
 				}
 
 				// Initialize buffers to store pitch-shifted spectrum
-				for(unsigned k=0; k<stft.numBins(); ++k){
-					stft.aux(TEMP_MAG)[k] = 0.;
-					stft.aux(TEMP_FRQ)[k] = k*stft.binFreq();
+				Spectral::clear(stft.aux(TEMP_MAG), n);
+				Spectral::clear(stft.aux(TEMP_FRQ), n);
+
+				// Every channel of the shift input is one voice of the harmonizer,
+				// all voices are remapped from the same analysis frame
+				int voices = std::max(inputs[INPUT_SHIFT].getChannels(), 1);
+				float gain = 1.f / std::sqrt(float(voices));
+
+				for (int v = 0; v < voices; v++) {
+					// The shift amount is only needed once per hop
+					float pshift = Cv::exp2(params[PARAM_SHIFT].getValue() + inputs[INPUT_SHIFT].getVoltage(v));
+
+					// Perform the pitch shift:
+					// Here we contract or expand the bins. For overlapping bins,
+					// we add the magnitudes and weight the frequencies by magnitude.
+					// Reference:
+					// http://oldsite.dspdimension.com/dspdimension.com/src/smbPitchShift.cpp
+					Spectral::remap(stft.aux(IN_MAG), stft.aux(IN_FRQ), pshift, gain, stft.aux(TEMP_MAG), stft.aux(TEMP_FRQ), n);
 				}
+				Spectral::weightedFrequency(stft.aux(TEMP_MAG), stft.aux(TEMP_FRQ), stft.binFreq(), n);
 
-				// Perform the pitch shift:
-				// Here we contract or expand the bins. For overlapping bins,
-				// we simply add the magnitudes and replace the frequency.
-				// Reference:
-				// http://oldsite.dspdimension.com/dspdimension.com/src/smbPitchShift.cpp
-				if (pshift > 0){
-					unsigned kmax = stft.numBins() / pshift;
-					if (kmax >= stft.numBins()) kmax = stft.numBins()-1;
-					for (unsigned k=1; k<kmax; ++k){
-						unsigned j = k*pshift;
-						stft.aux(TEMP_MAG)[j] += stft.bin(k)[0];
-						stft.aux(TEMP_FRQ)[j] = stft.bin(k)[1]*pshift;
-					}
+				if (Spectrum::Frame* frame = spectrum.begin(stft.numBins(), stft.binFreq())) {
+					spectrum.decimate(frame->in, [&](unsigned k) { return stft.aux(IN_MAG)[k]; });
+					spectrum.decimate(frame->out, [&](unsigned k) { return stft.aux(TEMP_MAG)[k]; });
+					frame->hasOut = true;
+					spectrum.publish();
 				}
 
 				// Copy pitch-shifted spectrum over to bins
-				stft.copyAuxToBins(TEMP_MAG, 0);
-				stft.copyAuxToBins(TEMP_FRQ, 1);
+				Spectral::interleave(stft.aux(TEMP_MAG), stft.aux(TEMP_FRQ), bins, n);
 			}
 
 			s = stft();
@@ -122,9 +143,19 @@ struct PitchWidget : ModuleWidget {
 		addParam(createParamCentered<StoermelderTrimpot>(Vec(22.5f, 73.0f), module, PitchModule::PARAM_SHIFT));
 		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 97.9f), module, PitchModule::INPUT_SHIFT));
 
+		Spectrum::SpectrumDisplay* display = createWidget<Spectrum::SpectrumDisplay>(Vec(7.5f, 120.f));
+		display->box.size = Vec(30.f, 130.f);
+		display->vertical = true;
+		display->publisher = module ? &module->spectrum : NULL;
+		addChild(display);
+
 		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 280.6f), module, PitchModule::INPUT));
 		addOutput(createOutputCentered<StoermelderPort>(Vec(22.5f, 323.8f), module, PitchModule::OUTPUT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Trace::appendContextMenu(menu);
+	}
 };
 
 } // namespace Pitch
@@ -1,16 +1,16 @@
 #include "plugin.hpp"
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wsuggest-override"
-#pragma GCC diagnostic ignored "-Wignored-qualifiers"
-#pragma GCC diagnostic ignored "-Wunused-function"
-#include "Gamma/DFT.h"
-#pragma GCC diagnostic pop
+#include "rift.hpp"
+#include "spectrum.hpp"
+#include "fft.hpp"
+#include "spectral.hpp"
+#include "trace.hpp"
+#include "quality.hpp"
+#include "shared.hpp"
 
 namespace RiftMk1 {
 
 // based on examples/spectral/brickwall.cpp
-struct RiftMk1Module : Module {
+struct RiftMk1Module : Module, Shared::Source {
 	enum ParamIds {
 		LO_PARAM,
 		LO_OFFSET_PARAM,
@@ -32,12 +32,15 @@ struct RiftMk1Module : Module {
 		NUM_LIGHTS
 	};
 
-	gam::STFT stft;
+	Fft::Stft stft;
 	float prev[PORT_MAX_CHANNELS];
 	float cvs[PORT_MAX_CHANNELS] = {};
+	Spectrum::Publisher spectrum;
+	Quality::Instance quality;
+	Shared::Client shared;
 
 	RiftMk1Module() :
-		stft(2048, 2048/4, 0, gam::HANN, gam::COMPLEX)
+		stft(2048, 2048/4)
 	{
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(LO_PARAM, 0.f, 2.f, 1.f, "Low CV Attenuation");
@@ -45,34 +48,53 @@ struct RiftMk1Module : Module {
 		configParam(HI_PARAM, 0.f, 2.f, 1.f, "High CV Attenuation");
 		configParam(HI_OFFSET_PARAM, -42.f, 78.f, 0.f, "High Frequency", " Hz", dsp::FREQ_SEMITONE, dsp::FREQ_C4);
 		onReset();
-		stft.precise(true);
+		onSampleRateChange();
 	}
 
-	void process(const ProcessArgs &args) override {
-		gam::Domain::master().spu(args.sampleRate);
+	void onSampleRateChange() override {
+		stft.setSampleRate(APP->engine->getSampleRate());
+	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		quality.dataToJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		quality.dataFromJson(rootJ);
+	}
 
+	void process(const ProcessArgs &args) override {
+		TRACE_ZONE("Rift Mk1");
+		Quality::Timer timer;
 		if (inputs[INPUT].isConnected()) {
 			float s = inputs[INPUT].getVoltage();
 
-			if (stft(s)) {
+			if (shared.process(stft, s, source.load(std::memory_order_relaxed), id)) {
+				TRACE_ZONE("Rift Mk1 frame");
+				timer.begin();
+				if (quality.update())
+					stft.setHop(Quality::hop(2048, 2048/4, quality.level.load(std::memory_order_relaxed)));
+
 				// Define the band edges, in Hz
-				float freqLoParam = params[LO_OFFSET_PARAM].getValue() / 12.f;
-				freqLoParam += inputs[LO_INPUT].isConnected() ? inputs[LO_INPUT].getVoltage() * params[LO_PARAM].getValue() / 5.f : 0.f;
-				float freqLo = dsp::FREQ_C4 * powf(2.0, freqLoParam);
-
-				float freqHiParam = params[HI_OFFSET_PARAM].getValue() / 12.f;
-				freqHiParam += inputs[HI_INPUT].isConnected() ? inputs[HI_INPUT].getVoltage() * params[HI_PARAM].getValue() / 5.f : 0.f;
-				float freqHi = dsp::FREQ_C4 * powf(2.0, freqHiParam);
-
-				for(unsigned k = 0; k < stft.numBins(); ++k){
-					// Compute the frequency, in Hz, of this bin
-					float freq = k*stft.binFreq();
-
-					// If the bin frequency is outside of our band, then zero the bin.
-					if (freq < freqLo || freq > freqHi){
-						stft.bin(k) = 0;
-					}
+				float freqLo = Rift::edgeFreq(this, LO_OFFSET_PARAM, LO_INPUT, LO_PARAM);
+				float freqHi = Rift::edgeFreq(this, HI_OFFSET_PARAM, HI_INPUT, HI_PARAM);
+
+				if (Spectrum::Frame* frame = spectrum.begin(stft.numBins(), stft.binFreq())) {
+					spectrum.decimate(frame->in, [&](unsigned k) { return stft.bin(k).mag(); });
+					spectrum.marker(frame, freqLo);
+					spectrum.marker(frame, freqHi);
+					spectrum.publish();
 				}
+
+				// Bins kLo..kHi-1 are inside of our band, zero all others
+				unsigned n = stft.numBins();
+				unsigned kLo = Spectral::binFrom(freqLo, stft.binFreq(), n);
+				unsigned kHi = std::max(Spectral::binPast(freqHi, stft.binFreq(), n), kLo);
+				float* bins = &stft.bin(0)[0];
+				Spectral::clearBins(bins, 0, kLo);
+				Spectral::clearBins(bins, kHi, n);
 			}
 
 			s = stft();
@@ -97,9 +119,28 @@ struct RiftMk1Widget : ModuleWidget {
 		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 188.2f), module, RiftMk1Module::HI_INPUT));
 		addParam(createParamCentered<StoermelderTrimpot>(Vec(22.5f, 213.2f), module, RiftMk1Module::HI_PARAM));
 
+		Spectrum::SpectrumDisplay* display = createWidget<Spectrum::SpectrumDisplay>(Vec(7.5f, 231.f));
+		display->box.size = Vec(30.f, 21.f);
+		display->publisher = module ? &module->spectrum : NULL;
+		addChild(display);
+
 		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 280.6f), module, RiftMk1Module::INPUT));
 		addOutput(createOutputCentered<StoermelderPort>(Vec(22.5f, 323.8f), module, RiftMk1Module::OUTPUT));
 	}
+
+	void step() override {
+		if (module) {
+			RiftMk1Module* m = dynamic_cast<RiftMk1Module*>(module);
+			m->source.store(Shared::sourceOf(this, RiftMk1Module::INPUT), std::memory_order_relaxed);
+		}
+		ModuleWidget::step();
+	}
+
+	void appendContextMenu(Menu* menu) override {
+		RiftMk1Module* module = dynamic_cast<RiftMk1Module*>(this->module);
+		Quality::appendContextMenu(menu, &module->quality);
+		Trace::appendContextMenu(menu);
+	}
 };
 
 } // namespace RiftMk1
@@ -1,11 +1,10 @@
 #include "plugin.hpp"
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wsuggest-override"
-#pragma GCC diagnostic ignored "-Wignored-qualifiers"
-#pragma GCC diagnostic ignored "-Wunused-function"
-#include "Gamma/DFT.h"
-#pragma GCC diagnostic pop
+#include "rift.hpp"
+#include "spectrum.hpp"
+#include "fft.hpp"
+#include "spectral.hpp"
+#include "trace.hpp"
+#include "quality.hpp"
 
 namespace RiftMk2 {
 
@@ -36,16 +35,18 @@ struct RiftMk2Module : Module {
 		NUM_LIGHTS
 	};
 
-	gam::STFT in1_stft, in2_stft;
-	gam::STFT out1_stft, out2_stft;
+	Fft::Stft in1_stft, in2_stft;
+	Fft::Stft out1_stft, out2_stft;
 	float prev[PORT_MAX_CHANNELS];
 	float cvs[PORT_MAX_CHANNELS] = {};
+	Spectrum::Publisher spectrum;
+	Quality::Instance quality;
 
 	RiftMk2Module() :
-		in1_stft(2048, 2048/4, 0, gam::HANN, gam::COMPLEX),
-		in2_stft(2048, 2048/4, 0, gam::HANN, gam::COMPLEX),
-		out1_stft(2048, 2048/4, 0, gam::HANN, gam::COMPLEX),
-		out2_stft(2048, 2048/4, 0, gam::HANN, gam::COMPLEX)
+		in1_stft(2048, 2048/4),
+		in2_stft(2048, 2048/4),
+		out1_stft(2048, 2048/4),
+		out2_stft(2048, 2048/4)
 	{
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(LO_PARAM, 0.f, 2.f, 1.f, "Low CV Attenuation");
@@ -53,44 +54,75 @@ struct RiftMk2Module : Module {
 		configParam(HI_PARAM, 0.f, 2.f, 1.f, "High CV Attenuation");
 		configParam(HI_OFFSET_PARAM, -42.f, 78.f, 0.f, "High Frequency", " Hz", dsp::FREQ_SEMITONE, dsp::FREQ_C4);
 		onReset();
-		in1_stft.precise(true);
-		in2_stft.precise(true);
-		out1_stft.precise(true);
-		out2_stft.precise(true);
+		onSampleRateChange();
 	}
 
-	void process(const ProcessArgs &args) override {
-		gam::Domain::master().spu(args.sampleRate);
+	void onSampleRateChange() override {
+		in1_stft.setSampleRate(APP->engine->getSampleRate());
+	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		quality.dataToJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		quality.dataFromJson(rootJ);
+	}
 
+	void process(const ProcessArgs &args) override {
+		TRACE_ZONE("Rift Mk2");
+		Quality::Timer timer;
 		float s1 = inputs[IN_INPUT].getVoltage();
 		float s2 = inputs[OUTER_INPUT].getVoltage();
 		float s3 = inputs[INNER_INPUT].getVoltage();
 
-		if (in1_stft(s1) || out1_stft(s2) || out2_stft(s3)) {
+		// All analyses are clocked on every sample to keep their frames aligned
+		bool frame1 = in1_stft(s1);
+		bool frame2 = out1_stft(s2);
+		bool frame3 = out2_stft(s3);
+
+		if (frame1 || frame2 || frame3) {
+			TRACE_ZONE("Rift Mk2 frame");
+			timer.begin();
+			if (quality.update()) {
+				int hop = Quality::hop(2048, 2048/4, quality.level.load(std::memory_order_relaxed));
+				in1_stft.setHop(hop);
+				in2_stft.setHop(hop);
+				out1_stft.setHop(hop);
+				out2_stft.setHop(hop);
+			}
+
 			// Define the band edges, in Hz
-			float freqLoParam = params[LO_OFFSET_PARAM].getValue() / 12.f;
-			freqLoParam += inputs[LO_INPUT].isConnected() ? inputs[LO_INPUT].getVoltage() * params[LO_PARAM].getValue() / 5.f : 0.f;
-			float freqLo = dsp::FREQ_C4 * powf(2.0, freqLoParam);
-
-			float freqHiParam = params[HI_OFFSET_PARAM].getValue() / 12.f;
-			freqHiParam += inputs[HI_INPUT].isConnected() ? inputs[HI_INPUT].getVoltage() * params[HI_PARAM].getValue() / 5.f : 0.f;
-			float freqHi = dsp::FREQ_C4 * powf(2.0, freqHiParam);
-
-			for(unsigned k = 0; k < in1_stft.numBins(); ++k){
-				// Compute the frequency, in Hz, of this bin
-				float freq = k * in1_stft.binFreq();
-
-				// If the bin frequency is outside of our band, then zero the bin.
-				if (freq < freqLo || freq > freqHi) {
-					in2_stft.bin(k)[0] = in1_stft.bin(k)[0];
-					in2_stft.bin(k)[1] = in1_stft.bin(k)[1];
-					in1_stft.bin(k) = 0;
-				} else {
-					in2_stft.bin(k) = 0;
-					out1_stft.bin(k)[0] = out2_stft.bin(k)[0];
-					out1_stft.bin(k)[1] = out2_stft.bin(k)[1];
-				}
+			float freqLo = Rift::edgeFreq(this, LO_OFFSET_PARAM, LO_INPUT, LO_PARAM);
+			float freqHi = Rift::edgeFreq(this, HI_OFFSET_PARAM, HI_INPUT, HI_PARAM);
+
+			if (Spectrum::Frame* frame = spectrum.begin(in1_stft.numBins(), in1_stft.binFreq())) {
+				spectrum.decimate(frame->in, [&](unsigned k) { return in1_stft.bin(k).mag(); });
+				spectrum.marker(frame, freqLo);
+				spectrum.marker(frame, freqHi);
+				spectrum.publish();
 			}
+
+			// Bins kLo..kHi-1 are inside of our band
+			unsigned n = in1_stft.numBins();
+			unsigned kLo = Spectral::binFrom(freqLo, in1_stft.binFreq(), n);
+			unsigned kHi = std::max(Spectral::binPast(freqHi, in1_stft.binFreq(), n), kLo);
+			float* in1 = &in1_stft.bin(0)[0];
+			float* in2 = &in2_stft.bin(0)[0];
+			float* out1 = &out1_stft.bin(0)[0];
+			float* out2 = &out2_stft.bin(0)[0];
+
+			// Outside of the band the input moves to the outer output
+			Spectral::copyBins(in2, in1, 0, kLo);
+			Spectral::copyBins(in2, in1, kHi, n);
+			Spectral::clearBins(in1, 0, kLo);
+			Spectral::clearBins(in1, kHi, n);
+
+			// Inside of the band the inner return replaces the outer one
+			Spectral::clearBins(in2, kLo, kHi);
+			Spectral::copyBins(out1, out2, kLo, kHi);
 		}
 
 		float o1 = in1_stft();
@@ -122,6 +154,11 @@ struct RiftMk2Widget : ModuleWidget {
 		addParam(createParamCentered<StoermelderTrimpot>(Vec(52.5f, 123.6f), module, RiftMk2Module::HI_PARAM));
 
 		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 183.4f), module, RiftMk2Module::IN_INPUT));
+		Spectrum::SpectrumDisplay* display = createWidget<Spectrum::SpectrumDisplay>(Vec(40.5f, 159.5f));
+		display->box.size = Vec(27.f, 39.f);
+		display->publisher = module ? &module->spectrum : NULL;
+		addChild(display);
+
 		addOutput(createOutputCentered<StoermelderPort>(Vec(22.5f, 226.9f), module, RiftMk2Module::OUTER_OUTPUT));
 		addOutput(createOutputCentered<StoermelderPort>(Vec(52.5f, 226.9f), module, RiftMk2Module::INNER_OUTPUT));
 
@@ -129,6 +166,12 @@ struct RiftMk2Widget : ModuleWidget {
 		addInput(createInputCentered<StoermelderPort>(Vec(52.5f, 280.6f), module, RiftMk2Module::INNER_INPUT));
 		addOutput(createOutputCentered<StoermelderPort>(Vec(52.5f, 323.8f), module, RiftMk2Module::OUT_OUTPUT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		RiftMk2Module* module = dynamic_cast<RiftMk2Module*>(this->module);
+		Quality::appendContextMenu(menu, &module->quality);
+		Trace::appendContextMenu(menu);
+	}
 };
 
 } // namespace RiftMk2
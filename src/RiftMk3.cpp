@@ -0,0 +1,177 @@
+#include "plugin.hpp"
+#include "rift.hpp"
+#include "spectrum.hpp"
+#include "fft.hpp"
+#include "spectral.hpp"
+#include "trace.hpp"
+#include "quality.hpp"
+#include "shared.hpp"
+
+namespace RiftMk3 {
+
+// based on examples/spectral/brickwall.cpp
+template <int BANDS>
+struct RiftMk3Module : Module, Shared::Source {
+	enum ParamIds {
+		ENUMS(FREQ_PARAM, BANDS - 1),
+		ENUMS(CV_PARAM, BANDS - 1),
+		NUM_PARAMS
+	};
+	enum InputIds {
+		ENUMS(CV_INPUT, BANDS - 1),
+		INPUT,
+		NUM_INPUTS
+	};
+	enum OutputIds {
+		ENUMS(BAND_OUTPUT, BANDS),
+		NUM_OUTPUTS
+	};
+	enum LightIds {
+		NUM_LIGHTS
+	};
+
+	// The first STFT analyzes the input and resynthesizes the lowest band,
+	// all others only resynthesize their band from the shared frame
+	Fft::Stft* stft[BANDS];
+	Spectrum::Publisher spectrum;
+	Quality::Instance quality;
+	Shared::Client shared;
+
+	RiftMk3Module() {
+		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+		for (int i = 0; i < BANDS - 1; i++) {
+			float f = -12.f + 60.f * i / std::max(BANDS - 2, 1);
+			configParam(FREQ_PARAM + i, -42.f, 78.f, f, string::f("Crossover %i-%i frequency", i + 1, i + 2), " Hz", dsp::FREQ_SEMITONE, dsp::FREQ_C4);
+			configParam(CV_PARAM + i, 0.f, 2.f, 1.f, string::f("Crossover %i-%i CV Attenuation", i + 1, i + 2));
+		}
+		for (int i = 0; i < BANDS; i++) {
+			stft[i] = new Fft::Stft(2048, 2048/4);
+		}
+		onReset();
+		onSampleRateChange();
+	}
+
+	~RiftMk3Module() {
+		for (int i = 0; i < BANDS; i++) {
+			delete stft[i];
+		}
+	}
+
+	void onSampleRateChange() override {
+		stft[0]->setSampleRate(APP->engine->getSampleRate());
+	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		quality.dataToJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		quality.dataFromJson(rootJ);
+	}
+
+	void process(const ProcessArgs &args) override {
+		TRACE_ZONE("Rift Mk3");
+		Quality::Timer timer;
+		float s = inputs[INPUT].getVoltage();
+
+		if (shared.process(*stft[0], s, source.load(std::memory_order_relaxed), id)) {
+			TRACE_ZONE("Rift Mk3 frame");
+			timer.begin();
+			if (quality.update()) {
+				for (int b = 0; b < BANDS; b++) {
+					stft[b]->setHop(Quality::hop(2048, 2048/4, quality.level.load(std::memory_order_relaxed)));
+				}
+			}
+
+			unsigned numBins = stft[0]->numBins();
+			float binFreq = stft[0]->binFreq();
+
+			// First bin of each band, crossovers are not allowed to pass each other
+			unsigned edge[BANDS + 1];
+			edge[0] = 0;
+			edge[BANDS] = numBins;
+			for (int i = 0; i < BANDS - 1; i++) {
+				float freq = Rift::edgeFreq(this, FREQ_PARAM + i, CV_INPUT + i, CV_PARAM + i);
+				unsigned k = Spectral::binFrom(freq, binFreq, numBins);
+				edge[i + 1] = std::min(std::max(k, edge[i]), numBins);
+			}
+
+			if (Spectrum::Frame* frame = spectrum.begin(numBins, binFreq)) {
+				spectrum.decimate(frame->in, [&](unsigned k) { return stft[0]->bin(k).mag(); });
+				for (int i = 1; i < BANDS; i++) {
+					spectrum.marker(frame, edge[i] * binFreq);
+				}
+				spectrum.publish();
+			}
+
+			// A frame taken from the shared cache may have moved the clock of the
+			// first band, the others are kept on it
+			float* in = &stft[0]->bin(0)[0];
+			for (int b = 1; b < BANDS; b++) {
+				stft[b]->sync();
+				float* out = &stft[b]->bin(0)[0];
+				Spectral::clearBins(out, 0, edge[b]);
+				Spectral::copyBins(out, in, edge[b], edge[b + 1]);
+				Spectral::clearBins(out, edge[b + 1], numBins);
+			}
+			Spectral::clearBins(in, edge[1], numBins);
+		}
+
+		// All bands are clocked on every sample to keep them aligned
+		for (int b = 0; b < BANDS; b++) {
+			float o = (*stft[b])();
+			outputs[BAND_OUTPUT + b].setVoltage(o);
+		}
+	}
+};
+
+struct RiftMk3Widget : ModuleWidget {
+	typedef RiftMk3Module<4> M;
+	RiftMk3Widget(M* module) {
+		setModule(module);
+		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/RiftMk3.svg")));
+
+		addChild(createWidget<MyBlackScrew>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<MyBlackScrew>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<MyBlackScrew>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+		addChild(createWidget<MyBlackScrew>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+
+		for (int i = 0; i < 3; i++) {
+			float x = 20.f + i * 25.f;
+			addParam(createParamCentered<StoermelderTrimpot>(Vec(x, 73.7f), module, M::FREQ_PARAM + i));
+			addInput(createInputCentered<StoermelderPort>(Vec(x, 97.9f), module, M::CV_INPUT + i));
+			addParam(createParamCentered<StoermelderTrimpot>(Vec(x, 123.6f), module, M::CV_PARAM + i));
+		}
+
+		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 183.4f), module, M::INPUT));
+		Spectrum::SpectrumDisplay* display = createWidget<Spectrum::SpectrumDisplay>(Vec(40.5f, 159.5f));
+		display->box.size = Vec(42.f, 39.f);
+		display->publisher = module ? &module->spectrum : NULL;
+		addChild(display);
+
+		addOutput(createOutputCentered<StoermelderPort>(Vec(22.5f, 226.9f), module, M::BAND_OUTPUT + 0));
+		addOutput(createOutputCentered<StoermelderPort>(Vec(67.5f, 226.9f), module, M::BAND_OUTPUT + 1));
+		addOutput(createOutputCentered<StoermelderPort>(Vec(22.5f, 280.6f), module, M::BAND_OUTPUT + 2));
+		addOutput(createOutputCentered<StoermelderPort>(Vec(67.5f, 280.6f), module, M::BAND_OUTPUT + 3));
+	}
+
+	void step() override {
+		if (module) {
+			M* m = dynamic_cast<M*>(module);
+			m->source.store(Shared::sourceOf(this, M::INPUT), std::memory_order_relaxed);
+		}
+		ModuleWidget::step();
+	}
+
+	void appendContextMenu(Menu* menu) override {
+		M* module = dynamic_cast<M*>(this->module);
+		Quality::appendContextMenu(menu, &module->quality);
+		Trace::appendContextMenu(menu);
+	}
+};
+
+} // namespace RiftMk3
+
+Model* modelRiftMk3 = createModel<RiftMk3::RiftMk3Module<4>, RiftMk3::RiftMk3Widget>("Rift-Mk3");
\ No newline at end of file
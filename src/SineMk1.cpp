@@ -1,4 +1,8 @@
 #include "plugin.hpp"
+#include "cv.hpp"
+#include "control.hpp"
+#include "trace.hpp"
+#include "dispatch.hpp"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsuggest-override"
@@ -9,6 +13,28 @@
 
 namespace SineMk1 {
 
+static const int MAX_VOICES = 8;
+
+/** Unison voices of one channel, the kernel runs in the variant for the CPU, see dispatch.hpp */
+struct Unison {
+	float phase[MAX_VOICES];
+	float prev[MAX_VOICES] = {};
+
+	Unison() {
+		// Free running voices, spread over the cycle so they don't start in phase
+		for (int k = 0; k < MAX_VOICES; k++) {
+			float x = k * 0.618034f;
+			phase[k] = x - std::floor(x);
+		}
+	}
+
+	/** Returns the weighted sum of the voices, inc is the phase increment of the unshifted pitch */
+	float process(float inc, const float* ratio, const float* gain, int voices, float fbk, float pm) {
+		// Feedback and external modulation per voice, as for the single oscillator
+		return Dispatch::kernels.unison(phase, prev, ratio, gain, voices, inc, fbk, pm);
+	}
+};
+
 // based on examples/synthesis/pmFeedback.cpp
 struct SineMk1Module : Module {
 	enum ParamIds {
@@ -17,11 +43,16 @@ struct SineMk1Module : Module {
 		FREQ_PARAM,
 		FINE_PARAM,
 		OCT_PARAM,
+		PM_PARAM,
+		UNISON_PARAM,
+		DETUNE_PARAM,
+		SPREAD_PARAM,
 		NUM_PARAMS
 	};
 	enum InputIds {
 		VOCT_INPUT,
 		FBK_INPUT,
+		PM_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds {
@@ -35,8 +66,26 @@ struct SineMk1Module : Module {
 
 	gam::Sine<> osc[PORT_MAX_CHANNELS];		// Source sine
 	float prev[PORT_MAX_CHANNELS];
-	float cvs[PORT_MAX_CHANNELS] = {};
+	Cv::VoctCache<simd::float_4> freq[PORT_MAX_CHANNELS / 4];
+	Cv::ConvexCache<simd::float_4> fbkTaper[PORT_MAX_CHANNELS / 4];
+	Control::LinearRamp<> freqRamp;
+	Control::LinearRamp<> fbkRamp;
+	Control::LinearRamp<> pmRamp;
+	bool fbkTaperOn;
+	Unison unison[PORT_MAX_CHANNELS];
+	float unisonRatio[MAX_VOICES];
+	float unisonGain[MAX_VOICES];
+	int voices = 1;
+	/** Inputs of the last updateUnison(), as in Cv::Cached */
+	int unisonVoices = 0;
+	float unisonDetune = NAN;
+	float unisonSpread = NAN;
 
+	Control::LinearRamp<simd::float_4> fbkCvRamp[PORT_MAX_CHANNELS / 4];
+	Control::LinearRamp<simd::float_4> pmCvRamp[PORT_MAX_CHANNELS / 4];
+
+	Control::Divider controlDivider;
+	Control::Settings control;
 	dsp::ClockDivider lightDivider;
 
 	SineMk1Module() {
@@ -46,51 +95,154 @@ struct SineMk1Module : Module {
 		configParam(FREQ_PARAM, -54.f, 54.f, 0.f, "Frequency", " Hz", dsp::FREQ_SEMITONE, dsp::FREQ_C4);
 		configParam(FINE_PARAM, -1.f, 1.f, 0.f, "Fine frequency");
 		configParam(OCT_PARAM, -3.f, 3.f, 0.f, "Octave");
+		configParam(PM_PARAM, -1.f, 1.f, 0.f, "Phase modulation amount", "%", 0.f, 100.f);
+		configParam(UNISON_PARAM, 1.f, MAX_VOICES, 1.f, "Unison voices");
+		configParam(DETUNE_PARAM, 0.f, 1.f, 0.2f, "Unison detune", " cents", 0.f, 100.f);
+		configParam(SPREAD_PARAM, 0.f, 1.f, 1.f, "Unison spread", "%", 0.f, 100.f);
 		onReset();
+		onSampleRateChange();
+		controlDivider.setDivision(Control::DIVISION);
+		control.setAudioRate(FBK_INPUT, true);
+		control.setAudioRate(PM_INPUT, true);
 		lightDivider.setDivision(32);
 	}
 
+	void onSampleRateChange() override {
+		gam::Domain::master().spu(APP->engine->getSampleRate());
+	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		control.dataToJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		control.dataFromJson(rootJ);
+	}
+
+	/**
+	 * Voices sit evenly across +-detune semitones, low spread attenuates the
+	 * outer ones. Recomputed only if voices or the knobs have changed.
+	 */
+	void updateUnison(float detune, float spread) {
+		if (voices == unisonVoices && detune == unisonDetune && spread == unisonSpread)
+			return;
+		unisonVoices = voices;
+		unisonDetune = detune;
+		unisonSpread = spread;
+
+		float sum = 0.f;
+		for (int k = 0; k < MAX_VOICES; k++) {
+			unisonRatio[k] = 0.f;
+			unisonGain[k] = 0.f;
+		}
+		for (int k = 0; k < voices; k++) {
+			float x = 2.f * k / (voices - 1) - 1.f;
+			unisonRatio[k] = std::pow(2.f, x * detune / 12.f);
+			unisonGain[k] = 1.f / (1.f + (1.f - spread) * 3.f * std::fabs(x));
+			sum += unisonGain[k];
+		}
+		// Normalized by amplitude, not power: the voices drift into phase and
+		// would peak at sqrt(voices) times the level of a single one
+		float norm = 1.f / sum;
+		for (int k = 0; k < voices; k++) {
+			unisonGain[k] *= norm;
+		}
+	}
+
 	void process(const ProcessArgs &args) override {
-		gam::Domain::master().spu(args.sampleRate);
+		TRACE_ZONE("Sine Mk1");
 		int channels = std::max(inputs[VOCT_INPUT].getChannels(), 1);
 		outputs[OUTPUT].setChannels(channels);
 
-		float freqParam = params[FREQ_PARAM].getValue() / 12.f;
-		freqParam += params[OCT_PARAM].getValue();
-		freqParam += dsp::quadraticBipolar(params[FINE_PARAM].getValue()) * 3.f / 12.f;
+		// Knobs are evaluated at control rate, V/OCT stays at audio rate, feedback
+		// CV and PM unless they are switched to control rate in the menu
+		control.update(controlDivider);
+		bool evaluate = controlDivider.process();
+		bool fbkAudio = control.isAudioRate(FBK_INPUT);
+		bool pmAudio = control.isAudioRate(PM_INPUT);
+		if (evaluate) {
+			float freqParam = params[FREQ_PARAM].getValue() / 12.f;
+			freqParam += params[OCT_PARAM].getValue();
+			freqParam += dsp::quadraticBipolar(params[FINE_PARAM].getValue()) * 3.f / 12.f;
+			freqRamp.setTarget(freqParam, controlDivider.getDivision());
+			fbkRamp.setTarget(params[FBK_PARAM].getValue(), controlDivider.getDivision());
+			pmRamp.setTarget(params[PM_PARAM].getValue(), controlDivider.getDivision());
+			fbkTaperOn = params[FBKTAPER_PARAM].getValue() == 1.f;
+			voices = clamp((int)params[UNISON_PARAM].getValue(), 1, MAX_VOICES);
+			if (voices > 1)
+				updateUnison(params[DETUNE_PARAM].getValue(), params[SPREAD_PARAM].getValue());
+		}
 
-		float fbkParam = params[FBK_PARAM].getValue();
+		float freqParam = freqRamp.process();
+		float fbkParam = fbkRamp.process();
+		bool fbkPoly = inputs[FBK_INPUT].getChannels() == channels;
+		float pmParam = pmRamp.process();
+		bool pmPoly = inputs[PM_INPUT].getChannels() == channels;
 
-		for (int i = 0; i < channels; i++) {
-			int c_fbk = inputs[FBK_INPUT].getChannels() == channels ? i : 0;
-			float fbk = inputs[FBK_INPUT].isConnected() ? inputs[FBK_INPUT].getVoltage(c_fbk) * fbkParam / 10.f : fbkParam;
-			if (params[FBKTAPER_PARAM].getValue() == 1.f)
-				fbk = 1 - powf(1 - fbk, 0.5f);
+		for (int c = 0; c < channels; c += 4) {
+			simd::float_4 fbk = fbkParam;
+			if (inputs[FBK_INPUT].isConnected()) {
+				simd::float_4 v = fbkPoly ? inputs[FBK_INPUT].getVoltageSimd<simd::float_4>(c) : inputs[FBK_INPUT].getVoltage(0);
+				if (!fbkAudio) {
+					if (evaluate)
+						fbkCvRamp[c / 4].setTarget(v, controlDivider.getDivision());
+					v = fbkCvRamp[c / 4].process();
+				}
+				fbk = v * fbkParam / 10.f;
+			}
+			if (fbkTaperOn)
+				fbk = fbkTaper[c / 4](fbk);
 
-			float pitch = freqParam + inputs[VOCT_INPUT].getVoltage(i);
-			if (pitch != cvs[i]) {
-				cvs[i] = pitch;
-				//float freq = dsp::FREQ_C4 * dsp::approxExp2_taylor5(pitch + 30) / 1073741824;
-				float freq = dsp::FREQ_C4 * powf(2.0, pitch);
-				osc[i].freq(freq);
+			// External phase modulation uses the same depth as full feedback at 5V
+			simd::float_4 pm = 0.f;
+			if (inputs[PM_INPUT].isConnected()) {
+				simd::float_4 v = pmPoly ? inputs[PM_INPUT].getVoltageSimd<simd::float_4>(c) : inputs[PM_INPUT].getVoltage(0);
+				if (!pmAudio) {
+					if (evaluate)
+						pmCvRamp[c / 4].setTarget(v, controlDivider.getDivision());
+					v = pmCvRamp[c / 4].process();
+				}
+				pm = v * pmParam * (0.4f / 5.f);
 			}
+			fbk *= 0.4f;
 
-			fbk = prev[i] * fbk * 0.4f;
-			// Add feedback to phase
-			osc[i].phaseAdd(fbk);
+			simd::float_4 pitch = freqParam + inputs[VOCT_INPUT].getVoltageSimd<simd::float_4>(c);
+			if (freq[c / 4].process(pitch)) {
+				// All oscillators of the lane follow the cache, inactive ones
+				// included, so they are in tune when channels are added
+				for (int j = 0; j < 4; j++)
+					osc[c + j].freq(freq[c / 4].out[j]);
+			}
 
-			prev[i] = osc[i]();
+			simd::float_4 out = 0.f;
+			for (int j = 0; j < 4 && c + j < channels; j++) {
+				int i = c + j;
+				// One voice stays on Gamma's scalar sine, only unison runs the dispatched kernel
+				if (voices > 1) {
+					float v = unison[i].process(freq[c / 4].out[j] * args.sampleTime, unisonRatio, unisonGain, voices, fbk[j], pm[j]);
+					out[j] = rescale(v, -1.f, 1.f, -5.f, 5.f);
+					continue;
+				}
 
-			// Subtract feedback from phase to avoid changing pitch
-			osc[i].phaseAdd(-fbk);
-			float o = rescale(prev[i], -1.f, 1.f, -5.f, 5.f);
-			outputs[OUTPUT].setVoltage(o, i);
+				float p = prev[i] * fbk[j] + pm[j];
+				// Add feedback and external modulation to phase
+				osc[i].phaseAdd(p);
+
+				prev[i] = osc[i]();
+
+				// Subtract it from phase to avoid changing pitch
+				osc[i].phaseAdd(-p);
+				out[j] = rescale(prev[i], -1.f, 1.f, -5.f, 5.f);
+			}
+			outputs[OUTPUT].setVoltageSimd(out, c);
 		}
 
 		// Light
 		if (lightDivider.process()) {
 			if (channels == 1) {
-				float lightValue = simd::sin(2 * M_PI * (osc[0].phase() * 2.f - 1.f));
+				float lightValue = voices > 1 ? simd::sin(2 * M_PI * unison[0].phase[0]) : simd::sin(2 * M_PI * (osc[0].phase() * 2.f - 1.f));
 				lights[PHASE_LIGHT + 0].setSmoothBrightness(-lightValue, args.sampleTime * lightDivider.getDivision());
 				lights[PHASE_LIGHT + 1].setSmoothBrightness(lightValue, args.sampleTime * lightDivider.getDivision());
 				lights[PHASE_LIGHT + 2].setBrightness(0.f);
@@ -110,12 +262,23 @@ struct SineMk1Widget : ModuleWidget {
 		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/SineMk1.svg")));
 
 		addChild(createWidget<MyBlackScrew>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<MyBlackScrew>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
 		addChild(createWidget<MyBlackScrew>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+		addChild(createWidget<MyBlackScrew>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 
 		addInput(createInputCentered<StoermelderPort>(Vec(22.5f, 74.8f), module, SineMk1Module::FBK_INPUT));
 		addParam(createParamCentered<StoermelderTrimpot>(Vec(22.5f, 99.9f), module, SineMk1Module::FBK_PARAM));
 		addParam(createParamCentered<CKSSH>(Vec(22.5f, 131.2f), module, SineMk1Module::FBKTAPER_PARAM));
 
+		addInput(createInputCentered<StoermelderPort>(Vec(67.5f, 74.8f), module, SineMk1Module::PM_INPUT));
+		addParam(createParamCentered<StoermelderTrimpot>(Vec(67.5f, 99.9f), module, SineMk1Module::PM_PARAM));
+
+		StoermelderTrimpot* tp2 = createParamCentered<StoermelderTrimpot>(Vec(67.5f, 171.3f), module, SineMk1Module::UNISON_PARAM);
+		tp2->snap = true;
+		addParam(tp2);
+		addParam(createParamCentered<StoermelderTrimpot>(Vec(67.5f, 200.8f), module, SineMk1Module::DETUNE_PARAM));
+		addParam(createParamCentered<StoermelderTrimpot>(Vec(67.5f, 230.2f), module, SineMk1Module::SPREAD_PARAM));
+
 		addParam(createParamCentered<StoermelderTrimpot>(Vec(22.5f, 171.3f), module, SineMk1Module::FREQ_PARAM));
 		addParam(createParamCentered<StoermelderTrimpot>(Vec(22.5f, 200.8f), module, SineMk1Module::FINE_PARAM));
 		StoermelderTrimpot* tp1 = createParamCentered<StoermelderTrimpot>(Vec(22.5f, 230.2f), module, SineMk1Module::OCT_PARAM);
@@ -127,6 +290,12 @@ struct SineMk1Widget : ModuleWidget {
 		addOutput(createOutputCentered<StoermelderPort>(Vec(22.5f, 318.3f), module, SineMk1Module::OUTPUT));
 		addChild(createLightCentered<SmallLight<RedGreenBlueLight>>(Vec(31.5f, 332.7f), module, SineMk1Module::PHASE_LIGHT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		SineMk1Module* module = dynamic_cast<SineMk1Module*>(this->module);
+		Control::appendContextMenu(menu, &module->control, {{SineMk1Module::FBK_INPUT, "Feedback"}, {SineMk1Module::PM_INPUT, "Phase modulation"}});
+		Trace::appendContextMenu(menu);
+	}
 };
 
 } // namespace SineMk1
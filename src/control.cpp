@@ -0,0 +1,44 @@
+#include "control.hpp"
+
+namespace Control {
+
+struct DivisionItem : MenuItem {
+	Settings* settings;
+	int division;
+
+	void onAction(const event::Action& e) override {
+		settings->division = division;
+	}
+
+	void step() override {
+		rightText = CHECKMARK(settings->division == division);
+		MenuItem::step();
+	}
+};
+
+struct AudioRateItem : MenuItem {
+	Settings* settings;
+	int id;
+
+	void onAction(const event::Action& e) override {
+		settings->setAudioRate(id, !settings->isAudioRate(id));
+	}
+
+	void step() override {
+		rightText = CHECKMARK(settings->isAudioRate(id));
+		MenuItem::step();
+	}
+};
+
+void appendContextMenu(ui::Menu* menu, Settings* settings, std::vector<AudioRateInput> inputs) {
+	menu->addChild(new MenuSeparator());
+	menu->addChild(createMenuLabel("Control rate"));
+	for (int i = 0; i < NUM_DIVISIONS; i++) {
+		menu->addChild(construct<DivisionItem>(&MenuItem::text, string::f("Every %d samples", DIVISIONS[i]), &DivisionItem::settings, settings, &DivisionItem::division, DIVISIONS[i]));
+	}
+	for (const AudioRateInput& input : inputs) {
+		menu->addChild(construct<AudioRateItem>(&MenuItem::text, string::f("%s CV at audio rate", input.name), &AudioRateItem::settings, settings, &AudioRateItem::id, input.id));
+	}
+}
+
+} // namespace Control
@@ -0,0 +1,140 @@
+#pragma once
+#include "plugin.hpp"
+#include <atomic>
+#include <cstring>
+
+namespace Control {
+
+/** Default number of samples between two evaluations of knobs and CV */
+static const int DIVISION = 16;
+
+/** Choices for the number of samples between two evaluations */
+static const int NUM_DIVISIONS = 4;
+static const int DIVISIONS[NUM_DIVISIONS] = {8, 16, 32, 64};
+
+/** Clock divider for control-rate evaluation, fires on the very first call */
+struct Divider {
+	int division = DIVISION;
+	int clock = 0;
+
+	void setDivision(int division) {
+		this->division = std::max(division, 1);
+		clock = 0;
+	}
+
+	int getDivision() {
+		return division;
+	}
+
+	bool process() {
+		if (clock > 0) {
+			clock--;
+			return false;
+		}
+		clock = division - 1;
+		return true;
+	}
+};
+
+/**
+ * Control rate of one module instance, set from the context menu and saved
+ * with the patch. Inputs flagged as audio rate are read on every sample
+ * instead of on the divider.
+ */
+struct Settings {
+	std::atomic<int> division{DIVISION};
+	/** Bit set of the input ids read at audio rate */
+	std::atomic<uint32_t> audioRate{0};
+
+	bool isAudioRate(int inputId) {
+		return audioRate.load(std::memory_order_relaxed) & (1u << inputId);
+	}
+
+	void setAudioRate(int inputId, bool on) {
+		if (on)
+			audioRate.fetch_or(1u << inputId);
+		else
+			audioRate.fetch_and(~(1u << inputId));
+	}
+
+	/** Applies a division changed from the menu, the divider fires on the next call then */
+	void update(Divider& divider) {
+		int d = division.load(std::memory_order_relaxed);
+		if (d != divider.getDivision())
+			divider.setDivision(d);
+	}
+
+	void dataToJson(json_t* rootJ) {
+		json_object_set_new(rootJ, "controlDivision", json_integer(division));
+		json_object_set_new(rootJ, "audioRateInputs", json_integer(audioRate));
+	}
+
+	void dataFromJson(json_t* rootJ) {
+		json_t* divisionJ = json_object_get(rootJ, "controlDivision");
+		if (divisionJ)
+			division = clamp((int)json_integer_value(divisionJ), 1, DIVISIONS[NUM_DIVISIONS - 1]);
+		json_t* audioRateJ = json_object_get(rootJ, "audioRateInputs");
+		if (audioRateJ)
+			audioRate = (uint32_t)json_integer_value(audioRateJ);
+	}
+};
+
+/** An input which can be switched to audio rate from the context menu */
+struct AudioRateInput {
+	int id;
+	const char* name;
+};
+
+void appendContextMenu(ui::Menu* menu, Settings* settings, std::vector<AudioRateInput> inputs);
+
+/**
+ * Linear interpolation of a value evaluated at control rate. Inputs flagged
+ * as audio rate in Settings bypass the ramp through jump().
+ */
+template <typename T = float>
+struct LinearRamp {
+	T value = 0.f;
+	T target = 0.f;
+	T delta = 0.f;
+	int steps = -1;
+
+	void reset(T v) {
+		value = target = v;
+		delta = 0.f;
+		steps = 0;
+	}
+
+	/** Starts a ramp from the current value to v over the given number of samples */
+	void setTarget(T v, int division) {
+		if (steps < 0) {
+			reset(v);
+			return;
+		}
+		if (std::memcmp(&v, &target, sizeof(T)) == 0)
+			return;
+		target = v;
+		delta = (target - value) / float(division);
+		steps = division;
+	}
+
+	/** Follows v without a ramp, for inputs read at audio rate, returns true if the value changed */
+	bool jump(T v) {
+		bool changed = steps != 0 || std::memcmp(&v, &target, sizeof(T)) != 0;
+		reset(v);
+		return changed;
+	}
+
+	bool isRamping() {
+		return steps > 0;
+	}
+
+	T process() {
+		if (steps > 0) {
+			steps--;
+			value = steps == 0 ? target : value + delta;
+		}
+		return value;
+	}
+};
+
+} // namespace Control
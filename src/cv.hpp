@@ -0,0 +1,88 @@
+#pragma once
+#include "plugin.hpp"
+#include <cstring>
+
+namespace Cv {
+
+enum class Exp2Quality {
+	FAST,		// 3rd order, max. relative error 7.5e-5 (~0.13 cents)
+	PRECISE		// 5th order, max. relative error 7.5e-8 (float resolution)
+};
+
+/** Minimax polynomial for 2^x on [0, 1) */
+template <Exp2Quality Q, typename T>
+inline T exp2Fraction(T x) {
+	if (Q == Exp2Quality::FAST) {
+		return 9.9992521856e-01f + x * (6.9583354051e-01f + x * (2.2606715539e-01f + x * 7.8024522664e-02f));
+	}
+	return 9.9999992506e-01f + x * (6.9315307320e-01f + x * (2.4015361705e-01f + x * (5.5826318050e-02f + x * (8.9893400947e-03f + x * 1.8775766734e-03f))));
+}
+
+/** Approximates 2^x by building the integer part directly in the exponent bits */
+template <Exp2Quality Q = Exp2Quality::PRECISE>
+inline float exp2(float x) {
+	x = clamp(x, -126.f, 126.f);
+	float xi = std::floor(x);
+	int32_t e = (int32_t(xi) + 127) << 23;
+	float y;
+	std::memcpy(&y, &e, sizeof(y));
+	return y * exp2Fraction<Q>(x - xi);
+}
+
+template <Exp2Quality Q = Exp2Quality::PRECISE>
+inline simd::float_4 exp2(simd::float_4 x) {
+	x = simd::clamp(x, -126.f, 126.f);
+	simd::float_4 xi = simd::floor(x);
+	simd::int32_4 e = (simd::int32_4(xi) + 127) << 23;
+	return simd::float_4::cast(e) * exp2Fraction<Q>(x - xi);
+}
+
+/** Converts V/OCT to Hz relative to C4 */
+template <Exp2Quality Q, typename T>
+inline T voctToFreq(T x) {
+	return dsp::FREQ_C4 * exp2<Q>(x);
+}
+
+/** Square-root taper, fast start: sqrt(x) */
+template <typename T>
+inline T taperConcave(T x) {
+	return simd::sqrt(x);
+}
+
+/** Square-root taper, slow start: 1 - sqrt(1 - x) */
+template <typename T>
+inline T taperConvex(T x) {
+	return 1.f - simd::sqrt(1.f - x);
+}
+
+/** Holds the result of F and recomputes it only if the bit pattern of the input changed */
+template <typename T, T (*F)(T)>
+struct Cached {
+	T in = T(NAN);
+	T out = T(0.f);
+
+	/** Returns true if the result has been recomputed */
+	bool process(T x) {
+		if (std::memcmp(&x, &in, sizeof(T)) == 0)
+			return false;
+		in = x;
+		out = F(x);
+		return true;
+	}
+
+	T operator()(T x) {
+		process(x);
+		return out;
+	}
+};
+
+template <typename T = float, Exp2Quality Q = Exp2Quality::PRECISE>
+using VoctCache = Cached<T, voctToFreq<Q, T>>;
+
+template <typename T = float>
+using ConcaveCache = Cached<T, taperConcave<T>>;
+
+template <typename T = float>
+using ConvexCache = Cached<T, taperConvex<T>>;
+
+} // namespace Cv
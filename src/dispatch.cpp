@@ -0,0 +1,50 @@
+#include "plugin.hpp"
+#include "dispatch.hpp"
+#include <cstdlib>
+
+namespace Dispatch {
+
+Kernels kernels;
+Isa isa = SSE3;
+
+static Isa detect() {
+	// The checks include the operating system's support for the wider registers
+	__builtin_cpu_init();
+#ifndef PACKGAMMA_NO_AVX
+	bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	if (avx2 && __builtin_cpu_supports("avx512f"))
+		return AVX512;
+	if (avx2)
+		return AVX2;
+#endif
+	if (__builtin_cpu_supports("sse4.1"))
+		return SSE41;
+	return SSE3;
+}
+
+static Kernels table(Isa isa) {
+	switch (isa) {
+#ifndef PACKGAMMA_NO_AVX
+		case AVX512: return Avx512::table();
+		case AVX2: return Avx2::table();
+#endif
+		case SSE41: return Sse41::table();
+		default: return Sse3::table();
+	}
+}
+
+void init() {
+	isa = detect();
+	// PACKGAMMA_ISA limits the selection to a narrower set, for comparing the variants
+	const char* env = std::getenv("PACKGAMMA_ISA");
+	if (env) {
+		for (int i = 0; i < isa; i++) {
+			if (std::string(env) == ISA_LABELS[i])
+				isa = (Isa)i;
+		}
+	}
+	kernels = table(isa);
+	INFO("PackGamma kernels: %s", ISA_LABELS[isa]);
+}
+
+} // namespace Dispatch
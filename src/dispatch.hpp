@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Runtime selection of the instruction set for the hot kernels. The kernels
+ * in kernels.hpp are compiled once per instruction set by src/kernels_*.cpp,
+ * with the flags set in the Makefile. init() picks the widest table the CPU
+ * supports, the modules call through Dispatch::kernels. Builds with
+ * PACKGAMMA_NO_AVX (Windows, see the Makefile) stop at SSE4.1. The quantizer
+ * mode of Bit Mk1 and the envelopes run Gamma's scalar code and are not
+ * dispatched.
+ */
+namespace Dispatch {
+
+enum Isa {
+	SSE3,
+	SSE41,
+	AVX2,
+	AVX512,
+	NUM_ISAS
+};
+
+static const char* const ISA_LABELS[NUM_ISAS] = {
+	"SSE3",
+	"SSE4.1",
+	"AVX2",
+	"AVX-512"
+};
+
+struct Kernels {
+	// Spectral bin loops, see spectral.hpp
+	float (*flux)(const float* cur, const float* prev, unsigned n);
+	void (*deinterleave)(const float* src, float* a, float* b, unsigned n);
+	void (*interleave)(const float* a, const float* b, float* dst, unsigned n);
+	void (*weightedFrequency)(const float* mag, float* frq, float binFreq, unsigned n);
+
+	// Windowing and overlap-add around the FFT
+	/** dst = a * b */
+	void (*multiply)(float* dst, const float* a, const float* b, unsigned n);
+	/** dst += a * b * gain */
+	void (*multiplyAdd)(float* dst, const float* a, const float* b, float gain, unsigned n);
+	/** dst += a * gain */
+	void (*scaleAdd)(float* dst, const float* a, float gain, unsigned n);
+
+	/**
+	 * Fixed-point crush of the Bit Mk1, in, out and noise hold PORT_MAX_CHANNELS
+	 * lanes, samples in -1..1
+	 */
+	void (*crush)(const float* in, float* out, int32_t* noise, int channels, int bits, bool dither);
+
+	/**
+	 * Unison voices of one channel of the Sine Mk1, all arrays hold 8 voices,
+	 * unused voices have no gain. Returns the weighted sum.
+	 */
+	float (*unison)(float* phase, float* prev, const float* ratio, const float* gain, int voices, float inc, float fbk, float pm);
+};
+
+extern Kernels kernels;
+extern Isa isa;
+
+// Tables of the variants, defined by src/kernels_*.cpp
+namespace Sse3 { Kernels table(); }
+namespace Sse41 { Kernels table(); }
+namespace Avx2 { Kernels table(); }
+namespace Avx512 { Kernels table(); }
+
+/** Detects the CPU and fills kernels, called from the plugin's init() */
+void init();
+
+} // namespace Dispatch
@@ -0,0 +1,299 @@
+#pragma once
+#include "plugin.hpp"
+#include "trace.hpp"
+#include "dispatch.hpp"
+#include <cstring>
+
+#ifdef PACKGAMMA_FFT_GAMMA
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsuggest-override"
+#pragma GCC diagnostic ignored "-Wignored-qualifiers"
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "Gamma/FFT.h"
+#pragma GCC diagnostic pop
+#endif
+
+namespace Fft {
+
+/**
+ * Real transform of `length` samples into length/2+1 interleaved complex bins.
+ * Neither direction is normalized, inverse(forward(x)) = length * x.
+ * The backend is selected at build time, see FFT in the Makefile. The samples
+ * have to be allocated with alignedNew(), pffft needs them 16-byte aligned.
+ */
+/** Samples for RealFft, on pffft's alignment whatever the backend */
+inline float* alignedNew(int length) {
+	return (float*) pffft_aligned_malloc(length * sizeof(float));
+}
+
+inline void alignedDelete(float* p) {
+	pffft_aligned_free(p);
+}
+
+#ifdef PACKGAMMA_FFT_GAMMA
+// Reference backend, Gamma's real transform
+struct RealFft {
+	gam::RFFT<float> fft;
+	int length;
+	float* buffer;
+
+	RealFft(int length) : fft(length), length(length) {
+		buffer = new float[length];
+	}
+
+	~RealFft() {
+		delete[] buffer;
+	}
+
+	void forward(const float* in, float* bins) {
+		// Output is [r0, r1, i1, r2, i2, ..., r(n/2)]
+		std::memcpy(buffer, in, length * sizeof(float));
+		fft.forward(buffer, false, false);
+		bins[0] = buffer[0];
+		bins[1] = 0.f;
+		std::memcpy(bins + 2, buffer + 1, (length - 2) * sizeof(float));
+		bins[length] = buffer[length - 1];
+		bins[length + 1] = 0.f;
+	}
+
+	void inverse(const float* bins, float* out) {
+		out[0] = bins[0];
+		std::memcpy(out + 1, bins + 2, (length - 2) * sizeof(float));
+		out[length - 1] = bins[length];
+		fft.inverse(out, false);
+	}
+};
+#else
+// Default backend, Rack's single precision SIMD transform (pffft)
+struct RealFft {
+	dsp::RealFFT fft;
+	int length;
+	float* buffer;
+
+	RealFft(int length) : fft(length), length(length) {
+		buffer = alignedNew(length);
+	}
+
+	~RealFft() {
+		alignedDelete(buffer);
+	}
+
+	void forward(const float* in, float* bins) {
+		// Output is [r0, r(n/2), r1, i1, r2, i2, ...]
+		fft.rfft(in, buffer);
+		bins[0] = buffer[0];
+		bins[1] = 0.f;
+		std::memcpy(bins + 2, buffer + 2, (length - 2) * sizeof(float));
+		bins[length] = buffer[1];
+		bins[length + 1] = 0.f;
+	}
+
+	void inverse(const float* bins, float* out) {
+		buffer[0] = bins[0];
+		buffer[1] = bins[length];
+		std::memcpy(buffer + 2, bins + 2, (length - 2) * sizeof(float));
+		fft.irfft(buffer, out);
+	}
+};
+#endif
+
+struct Bin {
+	float v[2];
+
+	float& operator[](int i) { return v[i]; }
+	const float& operator[](int i) const { return v[i]; }
+
+	Bin& operator=(float x) {
+		v[0] = x;
+		v[1] = 0.f;
+		return *this;
+	}
+
+	float mag() const {
+		return std::sqrt(v[0] * v[0] + v[1] * v[1]);
+	}
+};
+
+/**
+ * Short-time Fourier transform with complex bins, a replacement for gam::STFT
+ * in COMPLEX mode. Analysis uses a Hann window, resynthesis too if frames
+ * overlap at least four times.
+ * All buffers are allocated on construction. Analysis and resynthesis are
+ * clocked separately by the two call operators, so an instance which only
+ * resynthesizes bins written from another one stays aligned with it as long
+ * as both are called on every sample.
+ */
+struct Stft {
+	int size;
+	int hop;
+	float sampleRate = 44100.f;
+	RealFft fft;
+
+	float* window;
+	float* input;
+	float* frame;
+	float* output;
+	/** Overlap-added windows of the frames in output, kept while the hop changes */
+	float* envelope;
+	Bin* bins;
+	float sumWindow = 0.f;
+	float sumWindow2 = 0.f;
+	bool synthesisWindow;
+	float gain;
+
+	int inPos = 0;
+	int inTap = 0;
+	int outTap = 0;
+	/** Next sample of output, the samples before it are dropped with the next frame */
+	int outPos = 0;
+	/** Samples of output covered by frames since the start */
+	int filled = 0;
+	/** Samples until the frames added before the last hop change have been read */
+	int transition = 0;
+
+	Stft(int size, int hop) : size(size), hop(hop), fft(size) {
+		window = new float[size];
+		input = new float[size];
+		frame = alignedNew(size);
+		output = new float[size];
+		envelope = new float[size];
+		bins = new Bin[numBins()];
+
+		for (int i = 0; i < size; i++) {
+			window[i] = 0.5f - 0.5f * std::cos(2.f * M_PI * i / size);
+			sumWindow += window[i];
+			sumWindow2 += window[i] * window[i];
+		}
+		setHop(hop);
+		outTap = 0;
+
+		std::memset(input, 0, size * sizeof(float));
+		std::memset(output, 0, size * sizeof(float));
+		std::memset(bins, 0, numBins() * sizeof(Bin));
+	}
+
+	~Stft() {
+		delete[] window;
+		delete[] input;
+		alignedDelete(frame);
+		delete[] output;
+		delete[] envelope;
+		delete[] bins;
+	}
+
+	/**
+	 * Changes the hop size, to be called on all instances sharing bins in the
+	 * same sample, right after a frame has been analyzed
+	 */
+	void setHop(int hop) {
+		// The frames in output overlap the first frames of the new hop at
+		// another spacing, window and gain. Until they have been read, the
+		// output is divided by the sum of the windows it holds, which is one
+		// otherwise, so the level doesn't jump on the change.
+		if (hop != this->hop && filled >= size) {
+			if (transition == 0)
+				steadyEnvelope();
+			transition = size;
+		}
+		this->hop = hop;
+		// Overlap-add of the windows and the unnormalized transforms
+		synthesisWindow = size >= 4 * hop;
+		gain = hop / ((synthesisWindow ? sumWindow2 : sumWindow) * size);
+		sync();
+	}
+
+	void setSampleRate(float sampleRate) {
+		this->sampleRate = sampleRate;
+	}
+
+	unsigned numBins() {
+		return size / 2 + 1;
+	}
+
+	float binFreq() {
+		return sampleRate / size;
+	}
+
+	Bin& bin(unsigned k) {
+		return bins[k];
+	}
+
+	/** Feeds one input sample, returns true if a new frame of bins has been analyzed */
+	bool operator()(float s) {
+		input[inPos] = s;
+		if (++inPos >= size) inPos = 0;
+		if (++inTap < hop)
+			return false;
+		inTap = 0;
+		TRACE_ZONE("Stft analysis");
+
+		// inPos points to the oldest sample now
+		int n = size - inPos;
+		Dispatch::kernels.multiply(frame, input + inPos, window, n);
+		Dispatch::kernels.multiply(frame + n, input, window + n, size - n);
+		fft.forward(frame, &bins[0][0]);
+		return true;
+	}
+
+	/** Feeds one input sample without analyzing, keeps the history while the bins come from elsewhere */
+	void push(float s) {
+		input[inPos] = s;
+		if (++inPos >= size) inPos = 0;
+		if (++inTap >= hop) inTap = 0;
+	}
+
+	/** Starts a new hop in this sample, for bins which have been written from elsewhere */
+	void sync() {
+		inTap = 0;
+		outTap = hop - 1;
+	}
+
+	/** Returns the next resynthesized sample, the bins are transformed back once per hop */
+	float operator()() {
+		if (++outTap >= hop) {
+			outTap = 0;
+			TRACE_ZONE("Stft synthesis");
+			// Drops the samples read since the last frame, one hop unless the hop has just changed
+			std::memmove(output, output + outPos, (size - outPos) * sizeof(float));
+			std::memset(output + size - outPos, 0, outPos * sizeof(float));
+			fft.inverse(&bins[0][0], frame);
+			if (synthesisWindow)
+				Dispatch::kernels.multiplyAdd(output, frame, window, gain, size);
+			else
+				Dispatch::kernels.scaleAdd(output, frame, gain, size);
+			if (transition > 0) {
+				std::memmove(envelope, envelope + outPos, (size - outPos) * sizeof(float));
+				std::memset(envelope + size - outPos, 0, outPos * sizeof(float));
+				addEnvelope(0, gain * size);
+			}
+			filled = std::min(filled + outPos, size);
+			outPos = 0;
+		}
+		float s = output[outPos++];
+		if (transition > 0) {
+			transition--;
+			s /= envelope[outPos - 1];
+		}
+		return s;
+	}
+
+private:
+	/** Adds the window of a frame at offset, as overlap-added by operator()() */
+	void addEnvelope(int offset, float g) {
+		if (synthesisWindow)
+			Dispatch::kernels.multiplyAdd(envelope, window + offset, window + offset, g, size - offset);
+		else
+			Dispatch::kernels.scaleAdd(envelope, window + offset, g, size - offset);
+	}
+
+	/** Envelope of the frames in output after a steady run at the current hop */
+	void steadyEnvelope() {
+		std::memset(envelope, 0, size * sizeof(float));
+		// The last frame starts at the front of output, the ones before it a hop further each
+		for (int offset = 0; offset < size; offset += hop) {
+			addEnvelope(offset, gain * size);
+		}
+	}
+};
+
+} // namespace Fft
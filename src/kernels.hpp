@@ -0,0 +1,396 @@
+#pragma once
+// Included once per instruction set by src/kernels_*.cpp, which define
+// KERNELS_NAMESPACE and are compiled with the matching flags, see the
+// Makefile. Nothing from Rack or the standard library is used here: their
+// inline functions would be emitted with the wider instruction set and the
+// linker could pick that copy for the baseline code.
+#include "dispatch.hpp"
+#include <immintrin.h>
+
+namespace Dispatch {
+namespace KERNELS_NAMESPACE {
+
+static const float RAMP[16] = {0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f};
+
+
+// Four lanes, SSE3 or SSE4.1
+
+struct F4 {
+	static const int N = 4;
+	typedef F4 Mask;
+	__m128 v;
+	F4() {}
+	F4(__m128 v) : v(v) {}
+	F4(float x) : v(_mm_set1_ps(x)) {}
+	static F4 load(const float* p) { return _mm_loadu_ps(p); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+	float sum() const {
+		__m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+	}
+};
+
+struct I4 {
+	__m128i v;
+	I4() {}
+	I4(__m128i v) : v(v) {}
+	I4(int32_t x) : v(_mm_set1_epi32(x)) {}
+	static I4 load(const int32_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+	void store(int32_t* p) const { _mm_storeu_si128((__m128i*)p, v); }
+};
+
+inline F4 operator+(F4 a, F4 b) { return _mm_add_ps(a.v, b.v); }
+inline F4 operator-(F4 a, F4 b) { return _mm_sub_ps(a.v, b.v); }
+inline F4 operator*(F4 a, F4 b) { return _mm_mul_ps(a.v, b.v); }
+inline F4 operator/(F4 a, F4 b) { return _mm_div_ps(a.v, b.v); }
+inline F4 min(F4 a, F4 b) { return _mm_min_ps(a.v, b.v); }
+inline F4 max(F4 a, F4 b) { return _mm_max_ps(a.v, b.v); }
+inline F4 greater(F4 a, F4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+
+/** a where mask is set, b elsewhere */
+inline F4 select(F4 mask, F4 a, F4 b) {
+#ifdef __SSE4_1__
+	return _mm_blendv_ps(b.v, a.v, mask.v);
+#else
+	return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+#endif
+}
+
+inline F4 floor(F4 a) {
+#ifdef __SSE4_1__
+	return _mm_floor_ps(a.v);
+#else
+	// Truncation rounds negative fractions up, those need one less
+	F4 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+	return t - F4(_mm_and_ps(_mm_cmpgt_ps(t.v, a.v), _mm_set1_ps(1.f)));
+#endif
+}
+
+inline I4 operator+(I4 a, I4 b) { return _mm_add_epi32(a.v, b.v); }
+inline I4 operator-(I4 a, I4 b) { return _mm_sub_epi32(a.v, b.v); }
+inline I4 operator&(I4 a, I4 b) { return _mm_and_si128(a.v, b.v); }
+inline I4 operator^(I4 a, I4 b) { return _mm_xor_si128(a.v, b.v); }
+template <int S> inline I4 shiftLeft(I4 a) { return _mm_slli_epi32(a.v, S); }
+template <int S> inline I4 shiftRight(I4 a) { return _mm_srli_epi32(a.v, S); }
+/** Rounds to nearest */
+inline I4 toInt(F4 a) { return _mm_cvtps_epi32(a.v); }
+inline F4 toFloat(I4 a) { return _mm_cvtepi32_ps(a.v); }
+
+/** Splits the interleaved pairs of x and y into a and b */
+inline void deinterleave(F4 x, F4 y, F4& a, F4& b) {
+	a = _mm_shuffle_ps(x.v, y.v, _MM_SHUFFLE(2, 0, 2, 0));
+	b = _mm_shuffle_ps(x.v, y.v, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+inline void interleave(F4 a, F4 b, F4& x, F4& y) {
+	x = _mm_unpacklo_ps(a.v, b.v);
+	y = _mm_unpackhi_ps(a.v, b.v);
+}
+
+
+#ifdef __AVX2__
+// Eight lanes, AVX2 and FMA
+
+struct F8 {
+	static const int N = 8;
+	typedef F8 Mask;
+	__m256 v;
+	F8() {}
+	F8(__m256 v) : v(v) {}
+	F8(float x) : v(_mm256_set1_ps(x)) {}
+	static F8 load(const float* p) { return _mm256_loadu_ps(p); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+	float sum() const {
+		return F4(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1))).sum();
+	}
+};
+
+struct I8 {
+	__m256i v;
+	I8() {}
+	I8(__m256i v) : v(v) {}
+	I8(int32_t x) : v(_mm256_set1_epi32(x)) {}
+	static I8 load(const int32_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	void store(int32_t* p) const { _mm256_storeu_si256((__m256i*)p, v); }
+};
+
+inline F8 operator+(F8 a, F8 b) { return _mm256_add_ps(a.v, b.v); }
+inline F8 operator-(F8 a, F8 b) { return _mm256_sub_ps(a.v, b.v); }
+inline F8 operator*(F8 a, F8 b) { return _mm256_mul_ps(a.v, b.v); }
+inline F8 operator/(F8 a, F8 b) { return _mm256_div_ps(a.v, b.v); }
+inline F8 min(F8 a, F8 b) { return _mm256_min_ps(a.v, b.v); }
+inline F8 max(F8 a, F8 b) { return _mm256_max_ps(a.v, b.v); }
+inline F8 greater(F8 a, F8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline F8 select(F8 mask, F8 a, F8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+inline F8 floor(F8 a) { return _mm256_floor_ps(a.v); }
+
+inline I8 operator+(I8 a, I8 b) { return _mm256_add_epi32(a.v, b.v); }
+inline I8 operator-(I8 a, I8 b) { return _mm256_sub_epi32(a.v, b.v); }
+inline I8 operator&(I8 a, I8 b) { return _mm256_and_si256(a.v, b.v); }
+inline I8 operator^(I8 a, I8 b) { return _mm256_xor_si256(a.v, b.v); }
+template <int S> inline I8 shiftLeft(I8 a) { return _mm256_slli_epi32(a.v, S); }
+template <int S> inline I8 shiftRight(I8 a) { return _mm256_srli_epi32(a.v, S); }
+inline I8 toInt(F8 a) { return _mm256_cvtps_epi32(a.v); }
+inline F8 toFloat(I8 a) { return _mm256_cvtepi32_ps(a.v); }
+
+inline void deinterleave(F8 x, F8 y, F8& a, F8& b) {
+	// The shuffles work within 128-bit halves, the pairs of the halves are then put in order
+	__m256 even = _mm256_shuffle_ps(x.v, y.v, _MM_SHUFFLE(2, 0, 2, 0));
+	__m256 odd = _mm256_shuffle_ps(x.v, y.v, _MM_SHUFFLE(3, 1, 3, 1));
+	a = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0)));
+	b = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(odd), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+inline void interleave(F8 a, F8 b, F8& x, F8& y) {
+	__m256 lo = _mm256_unpacklo_ps(a.v, b.v);
+	__m256 hi = _mm256_unpackhi_ps(a.v, b.v);
+	x = _mm256_permute2f128_ps(lo, hi, 0x20);
+	y = _mm256_permute2f128_ps(lo, hi, 0x31);
+}
+#endif
+
+
+#ifdef __AVX512F__
+// Sixteen lanes, AVX-512F
+
+struct M16 {
+	__mmask16 m;
+};
+
+struct F16 {
+	static const int N = 16;
+	typedef M16 Mask;
+	__m512 v;
+	F16() {}
+	F16(__m512 v) : v(v) {}
+	F16(float x) : v(_mm512_set1_ps(x)) {}
+	static F16 load(const float* p) { return _mm512_loadu_ps(p); }
+	void store(float* p) const { _mm512_storeu_ps(p, v); }
+	float sum() const { return _mm512_reduce_add_ps(v); }
+};
+
+struct I16 {
+	__m512i v;
+	I16() {}
+	I16(__m512i v) : v(v) {}
+	I16(int32_t x) : v(_mm512_set1_epi32(x)) {}
+	static I16 load(const int32_t* p) { return _mm512_loadu_si512(p); }
+	void store(int32_t* p) const { _mm512_storeu_si512(p, v); }
+};
+
+inline F16 operator+(F16 a, F16 b) { return _mm512_add_ps(a.v, b.v); }
+inline F16 operator-(F16 a, F16 b) { return _mm512_sub_ps(a.v, b.v); }
+inline F16 operator*(F16 a, F16 b) { return _mm512_mul_ps(a.v, b.v); }
+inline F16 operator/(F16 a, F16 b) { return _mm512_div_ps(a.v, b.v); }
+inline F16 min(F16 a, F16 b) { return _mm512_min_ps(a.v, b.v); }
+inline F16 max(F16 a, F16 b) { return _mm512_max_ps(a.v, b.v); }
+inline M16 greater(F16 a, F16 b) { return M16{_mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ)}; }
+inline F16 select(M16 mask, F16 a, F16 b) { return _mm512_mask_blend_ps(mask.m, b.v, a.v); }
+inline F16 floor(F16 a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+inline I16 operator+(I16 a, I16 b) { return _mm512_add_epi32(a.v, b.v); }
+inline I16 operator-(I16 a, I16 b) { return _mm512_sub_epi32(a.v, b.v); }
+inline I16 operator&(I16 a, I16 b) { return _mm512_and_si512(a.v, b.v); }
+inline I16 operator^(I16 a, I16 b) { return _mm512_xor_si512(a.v, b.v); }
+template <int S> inline I16 shiftLeft(I16 a) { return _mm512_slli_epi32(a.v, S); }
+template <int S> inline I16 shiftRight(I16 a) { return _mm512_srli_epi32(a.v, S); }
+inline I16 toInt(F16 a) { return _mm512_cvtps_epi32(a.v); }
+inline F16 toFloat(I16 a) { return _mm512_cvtepi32_ps(a.v); }
+
+static const int32_t EVEN_16[16] = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30};
+static const int32_t ODD_16[16] = {1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31};
+static const int32_t LOW_16[16] = {0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23};
+static const int32_t HIGH_16[16] = {8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31};
+
+inline void deinterleave(F16 x, F16 y, F16& a, F16& b) {
+	a = _mm512_permutex2var_ps(x.v, _mm512_loadu_si512(EVEN_16), y.v);
+	b = _mm512_permutex2var_ps(x.v, _mm512_loadu_si512(ODD_16), y.v);
+}
+
+inline void interleave(F16 a, F16 b, F16& x, F16& y) {
+	x = _mm512_permutex2var_ps(a.v, _mm512_loadu_si512(LOW_16), b.v);
+	y = _mm512_permutex2var_ps(a.v, _mm512_loadu_si512(HIGH_16), b.v);
+}
+#endif
+
+
+// The widest vectors for the bin loops and the channels, the unison voices
+// are at most eight
+#if defined(__AVX512F__)
+typedef F16 F;
+typedef I16 I;
+typedef F8 FV;
+#elif defined(__AVX2__)
+typedef F8 F;
+typedef I8 I;
+typedef F8 FV;
+#else
+typedef F4 F;
+typedef I4 I;
+typedef F4 FV;
+#endif
+
+
+float flux(const float* cur, const float* prev, unsigned n) {
+	F sum = 0.f;
+	unsigned k = 0;
+	for (; k + F::N <= n; k += F::N) {
+		sum = sum + max(F::load(cur + k) - F::load(prev + k), 0.f);
+	}
+	float s = sum.sum();
+	for (; k < n; k++) {
+		float d = cur[k] - prev[k];
+		s += d > 0.f ? d : 0.f;
+	}
+	return s;
+}
+
+void deinterleave(const float* src, float* a, float* b, unsigned n) {
+	unsigned k = 0;
+	for (; k + F::N <= n; k += F::N) {
+		F va, vb;
+		deinterleave(F::load(src + 2 * k), F::load(src + 2 * k + F::N), va, vb);
+		va.store(a + k);
+		vb.store(b + k);
+	}
+	for (; k < n; k++) {
+		a[k] = src[2 * k];
+		b[k] = src[2 * k + 1];
+	}
+}
+
+void interleave(const float* a, const float* b, float* dst, unsigned n) {
+	unsigned k = 0;
+	for (; k + F::N <= n; k += F::N) {
+		F x, y;
+		interleave(F::load(a + k), F::load(b + k), x, y);
+		x.store(dst + 2 * k);
+		y.store(dst + 2 * k + F::N);
+	}
+	for (; k < n; k++) {
+		dst[2 * k] = a[k];
+		dst[2 * k + 1] = b[k];
+	}
+}
+
+void weightedFrequency(const float* mag, float* frq, float binFreq, unsigned n) {
+	F kf = F::load(RAMP);
+	unsigned k = 0;
+	for (; k + F::N <= n; k += F::N) {
+		F mv = F::load(mag + k);
+		F fv = F::load(frq + k);
+		select(greater(mv, 0.f), fv / mv, kf * binFreq).store(frq + k);
+		kf = kf + float(F::N);
+	}
+	for (; k < n; k++) {
+		frq[k] = mag[k] > 0.f ? frq[k] / mag[k] : k * binFreq;
+	}
+}
+
+void multiply(float* dst, const float* a, const float* b, unsigned n) {
+	unsigned k = 0;
+	for (; k + F::N <= n; k += F::N) {
+		(F::load(a + k) * F::load(b + k)).store(dst + k);
+	}
+	for (; k < n; k++) {
+		dst[k] = a[k] * b[k];
+	}
+}
+
+void multiplyAdd(float* dst, const float* a, const float* b, float gain, unsigned n) {
+	unsigned k = 0;
+	for (; k + F::N <= n; k += F::N) {
+		(F::load(dst + k) + F::load(a + k) * F::load(b + k) * gain).store(dst + k);
+	}
+	for (; k < n; k++) {
+		dst[k] += a[k] * b[k] * gain;
+	}
+}
+
+void scaleAdd(float* dst, const float* a, float gain, unsigned n) {
+	unsigned k = 0;
+	for (; k + F::N <= n; k += F::N) {
+		(F::load(dst + k) + F::load(a + k) * gain).store(dst + k);
+	}
+	for (; k < n; k++) {
+		dst[k] += a[k] * gain;
+	}
+}
+
+/** Xorshift32 in every lane */
+inline I random(I& s) {
+	s = s ^ shiftLeft<13>(s);
+	s = s ^ shiftRight<17>(s);
+	s = s ^ shiftLeft<5>(s);
+	return s;
+}
+
+void crush(const float* in, float* out, int32_t* noise, int channels, int bits, bool dither) {
+	// 24-bit fixed point, the lower bits are masked off
+	const float SCALE = 8388608.f;
+	int32_t lsb = 1 << (24 - bits);
+	float half = 0.5f * lsb / SCALE;
+	for (int c = 0; c < channels; c += F::N) {
+		F x = min(max(F::load(in + c), -1.f), 1.f - 1.f / SCALE) * SCALE;
+		I q = toInt(x);
+		if (dither) {
+			// Triangular noise of +-1 step from the difference of two uniform values
+			I s = I::load(noise + c);
+			I mask = lsb - 1;
+			I r1 = random(s) & mask;
+			I r2 = random(s) & mask;
+			q = q + r1 - r2;
+			s.store(noise + c);
+		}
+		q = q & I(-lsb);
+		// Middle of the step, the dither may not push the top step out of range
+		F y = toFloat(q) * (1.f / SCALE) + half;
+		min(max(y, -1.f + half), 1.f - half).store(out + c);
+	}
+}
+
+/** sin(2 pi x), folded to a quarter period for an odd polynomial */
+template <class V>
+inline V sin2pi(V x) {
+	V y = x - floor(x + 0.5f);
+	y = min(y, V(0.5f) - y);
+	y = max(y, V(-0.5f) - y);
+	V t = y * 6.2831853f;
+	V t2 = t * t;
+	V p = V(1.f / 362880.f) + t2 * (-1.f / 39916800.f);
+	p = V(-1.f / 5040.f) + t2 * p;
+	p = V(1.f / 120.f) + t2 * p;
+	p = V(-1.f / 6.f) + t2 * p;
+	p = V(1.f) + t2 * p;
+	return t * p;
+}
+
+float unison(float* phase, float* prev, const float* ratio, const float* gain, int voices, float inc, float fbk, float pm) {
+	FV sum = 0.f;
+	for (int v = 0; v < voices; v += FV::N) {
+		FV ph = FV::load(phase + v);
+		FV s = sin2pi(ph + FV::load(prev + v) * fbk + pm);
+		s.store(prev + v);
+		sum = sum + s * FV::load(gain + v);
+		ph = ph + FV::load(ratio + v) * inc;
+		(ph - floor(ph)).store(phase + v);
+	}
+	return sum.sum();
+}
+
+Kernels table() {
+	Kernels k;
+	k.flux = flux;
+	k.deinterleave = deinterleave;
+	k.interleave = interleave;
+	k.weightedFrequency = weightedFrequency;
+	k.multiply = multiply;
+	k.multiplyAdd = multiplyAdd;
+	k.scaleAdd = scaleAdd;
+	k.crush = crush;
+	k.unison = unison;
+	return k;
+}
+
+} // namespace KERNELS_NAMESPACE
+} // namespace Dispatch
@@ -0,0 +1,3 @@
+// Kernels for AVX2, compiled with -mavx2 -mfma, see the Makefile
+#define KERNELS_NAMESPACE Avx2
+#include "kernels.hpp"
@@ -0,0 +1,8 @@
+// Kernels for AVX-512, compiled with -mavx512f -mavx2 -mfma, see the Makefile
+#define KERNELS_NAMESPACE Avx512
+// GCC warns about the undefined vectors inside its own AVX-512 intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include "kernels.hpp"
+#pragma GCC diagnostic pop
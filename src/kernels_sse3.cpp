@@ -0,0 +1,3 @@
+// Baseline kernels, compiled with Rack's flags
+#define KERNELS_NAMESPACE Sse3
+#include "kernels.hpp"
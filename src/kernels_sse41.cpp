@@ -0,0 +1,3 @@
+// Kernels for SSE4.1, compiled with -msse4.1, see the Makefile
+#define KERNELS_NAMESPACE Sse41
+#include "kernels.hpp"
@@ -1,10 +1,12 @@
 #include "plugin.hpp"
+#include "dispatch.hpp"
 
 
 Plugin* pluginInstance;
 
 void init(rack::Plugin* p) {
 	pluginInstance = p;
+	Dispatch::init();
 
 	p->addModel(modelFreezeMk1);
 	p->addModel(modelDecayMk1);
@@ -13,5 +15,6 @@ void init(rack::Plugin* p) {
 	p->addModel(modelCheb12Mk1);
 	p->addModel(modelRiftMk1);
 	p->addModel(modelRiftMk2);
+	p->addModel(modelRiftMk3);
 	p->addModel(modelPitch);
 }
\ No newline at end of file
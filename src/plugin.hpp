@@ -13,4 +13,5 @@ extern Model* modelSineMk1;
 extern Model* modelCheb12Mk1;
 extern Model* modelRiftMk1;
 extern Model* modelRiftMk2;
+extern Model* modelRiftMk3;
 extern Model* modelPitch;
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "quality.hpp"
+
+namespace Quality {
+
+Scheduler scheduler;
+
+void Scheduler::add(int64_t start, int64_t end) {
+	spectral.fetch_add(end - start, std::memory_order_relaxed);
+
+	// The first instance past the period evaluates the load
+	int64_t l = last.load(std::memory_order_relaxed);
+	if (end - l < PERIOD || !last.compare_exchange_strong(l, end))
+		return;
+	if (l == 0)
+		return;
+
+	int threads = std::max(APP->engine->getThreadCount(), 1);
+	float load = float(spectral.exchange(0)) / float((end - l) * threads);
+	int current = level.load(std::memory_order_relaxed);
+	if (load > DEGRADE && current < NUM_LEVELS - 1)
+		level.store(current + 1);
+	else if (load < RESTORE && current > FULL)
+		level.store(current - 1);
+}
+
+struct FloorItem : MenuItem {
+	Instance* instance;
+	int floor;
+
+	void onAction(const event::Action& e) override {
+		instance->floor.store(floor, std::memory_order_relaxed);
+	}
+
+	void step() override {
+		rightText = CHECKMARK(instance->floor.load(std::memory_order_relaxed) == floor);
+		MenuItem::step();
+	}
+};
+
+void appendContextMenu(ui::Menu* menu, Instance* instance) {
+	menu->addChild(new MenuSeparator());
+	menu->addChild(createMenuLabel(string::f("Quality: %s", LEVEL_LABELS[instance->level.load(std::memory_order_relaxed)])));
+	menu->addChild(createMenuLabel("Lowest quality under load"));
+	for (int i = 0; i < NUM_LEVELS; i++) {
+		menu->addChild(construct<FloorItem>(&MenuItem::text, LEVEL_LABELS[i], &FloorItem::instance, instance, &FloorItem::floor, i));
+	}
+}
+
+} // namespace Quality
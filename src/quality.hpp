@@ -0,0 +1,101 @@
+#pragma once
+#include "plugin.hpp"
+#include <atomic>
+#include <chrono>
+
+/**
+ * Plugin-wide quality scheduler for the spectral modules. Every instance
+ * reports the time spent on its frames, which is compared with the time the
+ * engine threads had available. Under load the overlap of the transforms is
+ * reduced, when the headroom is back full quality is restored.
+ */
+namespace Quality {
+
+enum Level {
+	FULL,
+	HALF_OVERLAP,
+	NUM_LEVELS
+};
+
+static const char* const LEVEL_LABELS[NUM_LEVELS] = {
+	"Full",
+	"Half overlap"
+};
+
+/** Hop size of the transform for a level */
+inline int hop(int size, int hop, int level) {
+	return level == HALF_OVERLAP ? std::max(hop, size / 2) : hop;
+}
+
+struct Scheduler {
+	/** Nanoseconds between two evaluations of the load */
+	static const int64_t PERIOD = 250000000;
+	/** Share of the engine time above which quality is reduced */
+	static constexpr float DEGRADE = 0.5f;
+	/** Share of the engine time below which quality is restored */
+	static constexpr float RESTORE = 0.15f;
+
+	std::atomic<int64_t> spectral{0};
+	std::atomic<int64_t> last{0};
+	std::atomic<int> level{FULL};
+
+	static int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void add(int64_t start, int64_t end);
+};
+
+extern Scheduler scheduler;
+
+/**
+ * Measures the enclosing scope as spectral work once begin() has been called.
+ * The transforms run once per hop, so only the samples which analyze and
+ * resynthesize a frame read the clock and report to the scheduler.
+ */
+struct Timer {
+	int64_t start = 0;
+
+	void begin() {
+		start = Scheduler::now();
+	}
+
+	~Timer() {
+		if (start > 0)
+			scheduler.add(start, Scheduler::now());
+	}
+};
+
+/**
+ * Quality state of one module instance. The floor is set from the UI thread
+ * and the level read by the menu while the engine updates them, both are
+ * atomic and relaxed, no other state depends on their order.
+ */
+struct Instance {
+	/** Lowest level this instance may be lowered to */
+	std::atomic<int> floor{NUM_LEVELS - 1};
+	std::atomic<int> level{FULL};
+
+	/** Follows the scheduler within the floor, returns true if the level has changed */
+	bool update() {
+		int l = std::min(scheduler.level.load(std::memory_order_relaxed), floor.load(std::memory_order_relaxed));
+		if (l == level.load(std::memory_order_relaxed))
+			return false;
+		level.store(l, std::memory_order_relaxed);
+		return true;
+	}
+
+	void dataToJson(json_t* rootJ) {
+		json_object_set_new(rootJ, "qualityFloor", json_integer(floor.load(std::memory_order_relaxed)));
+	}
+
+	void dataFromJson(json_t* rootJ) {
+		json_t* floorJ = json_object_get(rootJ, "qualityFloor");
+		if (floorJ)
+			floor.store(clamp((int)json_integer_value(floorJ), 0, NUM_LEVELS - 1), std::memory_order_relaxed);
+	}
+};
+
+void appendContextMenu(ui::Menu* menu, Instance* instance);
+
+} // namespace Quality
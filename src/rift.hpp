@@ -0,0 +1,14 @@
+#pragma once
+#include "plugin.hpp"
+#include "cv.hpp"
+
+namespace Rift {
+
+/** Band edge in Hz from an offset knob in semitones relative to C4 and an attenuated CV input */
+inline float edgeFreq(Module* m, int offsetParam, int cvInput, int cvParam) {
+	float v = m->params[offsetParam].getValue() / 12.f;
+	v += m->inputs[cvInput].isConnected() ? m->inputs[cvInput].getVoltage() * m->params[cvParam].getValue() / 5.f : 0.f;
+	return Cv::voctToFreq<Cv::Exp2Quality::PRECISE>(v);
+}
+
+} // namespace Rift
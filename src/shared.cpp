@@ -0,0 +1,169 @@
+#include "shared.hpp"
+#include <cstring>
+
+namespace Shared {
+
+static Slot slots[SLOTS];
+
+static int configOf(Fft::Stft& stft) {
+	return (stft.size << 16) | stft.hop;
+}
+
+int64_t sourceOf(app::ModuleWidget* mw, int inputId) {
+	app::PortWidget* port = mw->getInput(inputId);
+	if (!port)
+		return -1;
+	for (app::CableWidget* cw : APP->scene->rack->getCablesOnPort(port)) {
+		if (cw->isComplete() && cw->cable)
+			return (int64_t(cw->cable->outputModule->id) << 16) | cw->cable->outputId;
+	}
+	return -1;
+}
+
+bool Client::process(Fft::Stft& stft, float s, int64_t key, int id) {
+	if (key != this->key) {
+		release();
+		this->key = key;
+		if (key >= 0 && stft.size <= MAX_SIZE)
+			acquire(stft, id);
+	}
+
+	if (slot < 0)
+		return stft(s);
+
+	// A leader which hasn't been processed for a while may have been replaced
+	Slot& sl = slots[slot];
+	if (leading && sl.leader.load(std::memory_order_relaxed) != this->id) {
+		follow(sl);
+	}
+
+	if (leading) {
+		if (!stft(s))
+			return false;
+		publish(stft);
+		return true;
+	}
+
+	stft.push(s);
+	if (due > 0 && --due == 0) {
+		if (consume(stft)) {
+			idle = 0;
+			due = stft.hop;
+			return true;
+		}
+		// No frame in this hop, wait for the next one to align again
+		due = -1;
+	}
+	// The leader published either in this sample or in the previous one,
+	// depending on the processing order, the frame is taken in the next
+	// sample where it is available either way. From then on frames are taken
+	// once per hop at the same offset, whatever the order of later samples.
+	if (due < 0 && sl.count.load(std::memory_order_relaxed) != consumed)
+		due = 1;
+
+	// A new leader gets its own time to deliver the first frame
+	int leader = sl.leader.load(std::memory_order_relaxed);
+	if (leader != this->leader) {
+		this->leader = leader;
+		idle = 0;
+	}
+
+	// Take over if the leader has been gone for more than two hops
+	if (++idle > 2 * stft.hop) {
+		if (sl.key.load() != key || sl.config.load() != configOf(stft)) {
+			release();
+			this->key = key;
+			acquire(stft, id);
+		}
+		else if (sl.leader.compare_exchange_strong(leader, id)) {
+			this->id = id;
+			leading = true;
+		}
+		idle = 0;
+	}
+	return false;
+}
+
+void Client::acquire(Fft::Stft& stft, int id) {
+	int config = configOf(stft);
+	// Follow an existing analysis of the same source
+	for (int i = 0; i < SLOTS; i++) {
+		Slot& sl = slots[i];
+		if (sl.leader.load() != NO_LEADER && sl.key.load() == key && sl.config.load() == config) {
+			slot = i;
+			this->id = id;
+			follow(sl);
+			return;
+		}
+	}
+	// Or lead a free slot
+	for (int i = 0; i < SLOTS; i++) {
+		Slot& sl = slots[i];
+		int leader = NO_LEADER;
+		if (sl.leader.compare_exchange_strong(leader, id)) {
+			sl.key.store(key);
+			sl.config.store(config);
+			slot = i;
+			this->id = id;
+			leading = true;
+			return;
+		}
+	}
+}
+
+void Client::follow(Slot& sl) {
+	leading = false;
+	consumed = sl.count.load();
+	idle = 0;
+	due = -1;
+	leader = sl.leader.load();
+}
+
+void Client::release() {
+	// Only if no other client has taken over in the meantime
+	if (slot >= 0 && leading) {
+		int me = id;
+		slots[slot].leader.compare_exchange_strong(me, NO_LEADER);
+	}
+	slot = -1;
+	leading = false;
+	key = -1;
+}
+
+void Client::publish(Fft::Stft& stft) {
+	Slot& sl = slots[slot];
+	// The quality scheduler may have changed the hop since the slot was taken
+	sl.config.store(configOf(stft), std::memory_order_relaxed);
+	uint32_t n = sl.count.load(std::memory_order_relaxed) + 1;
+	std::atomic<uint32_t>& seq = sl.seq[n & 1];
+	uint32_t q = seq.load(std::memory_order_relaxed);
+	// Odd while writing, a follower still copying the previous frame of this buffer discards it
+	seq.store(q + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(sl.data[n & 1], &stft.bin(0)[0], 2 * stft.numBins() * sizeof(float));
+	seq.store(q + 2, std::memory_order_release);
+	sl.count.store(n, std::memory_order_release);
+}
+
+bool Client::consume(Fft::Stft& stft) {
+	Slot& sl = slots[slot];
+	uint32_t n = sl.count.load(std::memory_order_acquire);
+	if (n == consumed)
+		return false;
+	std::atomic<uint32_t>& seq = sl.seq[n & 1];
+	uint32_t q = seq.load(std::memory_order_acquire);
+	if (q & 1)
+		return false;
+	std::memcpy(&stft.bin(0)[0], sl.data[n & 1], 2 * stft.numBins() * sizeof(float));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	// The buffer has been written while copying, or the slot went to another source
+	if (seq.load(std::memory_order_relaxed) != q || sl.count.load(std::memory_order_relaxed) - n >= 2)
+		return false;
+	if (sl.key.load() != key || sl.config.load() != configOf(stft))
+		return false;
+	consumed = n;
+	stft.sync();
+	return true;
+}
+
+} // namespace Shared
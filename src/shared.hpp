@@ -0,0 +1,72 @@
+#pragma once
+#include "plugin.hpp"
+#include "fft.hpp"
+#include <atomic>
+
+/**
+ * Plugin-wide cache of spectral analyses. Instances fed from the same output
+ * port with the same transform configuration share one analysis: the first
+ * one becomes the leader and publishes its frames, the others follow and
+ * take the frames instead of running their own forward transform.
+ * Followers take each frame one or two samples after the leader analyzed it,
+ * the offset is fixed when they start following, so it doesn't change with
+ * the order the engine threads process the modules in.
+ */
+namespace Shared {
+
+static const int SLOTS = 16;
+static const int MAX_SIZE = 2048;
+static const int NO_LEADER = -1;
+
+/** Upstream output port of an input of a module widget, -1 if not connected */
+int64_t sourceOf(app::ModuleWidget* mw, int inputId);
+
+/** Base of the modules with a shared analysis, found by the audit with a cast */
+struct Source {
+	/** Output port feeding the analyzed input, set by the widget from sourceOf() */
+	std::atomic<int64_t> source{-1};
+};
+
+struct Slot {
+	std::atomic<int> leader{NO_LEADER};
+	std::atomic<int64_t> key{-1};
+	std::atomic<int> config{0};
+	/** Number of frames published, the frame n is kept in data[n & 1] */
+	std::atomic<uint32_t> count{0};
+	/** Sequence of each buffer, odd while the leader writes into it */
+	std::atomic<uint32_t> seq[2] = {{0}, {0}};
+	float data[2][MAX_SIZE + 2];
+};
+
+struct Client {
+	int slot = -1;
+	/** Module id this client leads or takes over with */
+	int id = NO_LEADER;
+	bool leading = false;
+	int64_t key = -1;
+	uint32_t consumed = 0;
+	/** Samples since the last frame from the leader */
+	int idle = 0;
+	int leader = NO_LEADER;
+	/** Samples until the next frame is taken from the leader, -1 until aligned */
+	int due = -1;
+
+	~Client() {
+		release();
+	}
+
+	/**
+	 * Feeds one sample for the analysis of source key, returns true if the bins
+	 * of stft hold a new frame, either analyzed here or taken from the leader.
+	 */
+	bool process(Fft::Stft& stft, float s, int64_t key, int id);
+	void release();
+
+private:
+	void acquire(Fft::Stft& stft, int id);
+	void follow(Slot& sl);
+	void publish(Fft::Stft& stft);
+	bool consume(Fft::Stft& stft);
+};
+
+} // namespace Shared
@@ -0,0 +1,103 @@
+#pragma once
+#include "plugin.hpp"
+#include "dispatch.hpp"
+#include <cstring>
+
+/**
+ * Vectorized kernels for the per-frame bin loops of the spectral modules.
+ * Magnitude and frequency kernels work on contiguous arrays of n bins,
+ * complex bins are interleaved (re, im) and are addressed by bin index.
+ * The loops over all bins run in the variant for the CPU, see dispatch.hpp.
+ */
+namespace Spectral {
+
+using simd::float_4;
+using simd::int32_4;
+
+/** L^1 norm of the positive changes from prev to cur */
+inline float flux(const float* cur, const float* prev, unsigned n) {
+	return Dispatch::kernels.flux(cur, prev, n);
+}
+
+inline void copy(float* dst, const float* src, unsigned n) {
+	std::memcpy(dst, src, n * sizeof(float));
+}
+
+inline void clear(float* dst, unsigned n) {
+	std::memset(dst, 0, n * sizeof(float));
+}
+
+/** Splits interleaved pairs of n bins into two arrays */
+inline void deinterleave(const float* src, float* a, float* b, unsigned n) {
+	Dispatch::kernels.deinterleave(src, a, b, n);
+}
+
+inline void interleave(const float* a, const float* b, float* dst, unsigned n) {
+	Dispatch::kernels.interleave(a, b, dst, n);
+}
+
+/**
+ * Adds the bins of mag/frq shifted by a factor onto outMag/outFrq. Overlapping
+ * bins sum their magnitudes, outFrq collects the magnitude-weighted frequency
+ * and has to be passed through weightedFrequency() after the last remap.
+ */
+inline void remap(const float* mag, const float* frq, float shift, float gain, float* outMag, float* outFrq, unsigned n) {
+	if (shift <= 0.f)
+		return;
+	unsigned kmax = n / shift;
+	if (kmax >= n) kmax = n - 1;
+
+	// Target indices and weights are computed four bins at a time, the
+	// scatter itself stays scalar to keep the order of overlapping bins
+	int32_t j[4];
+	float m[4];
+	float f[4];
+	float_4 kf = float_4(1.f, 2.f, 3.f, 4.f);
+	unsigned k = 1;
+	for (; k + 4 <= kmax; k += 4) {
+		int32_4(kf * shift).store(j);
+		float_4 mv = float_4::load(mag + k) * gain;
+		mv.store(m);
+		(mv * float_4::load(frq + k) * shift).store(f);
+		for (int l = 0; l < 4; l++) {
+			outMag[j[l]] += m[l];
+			outFrq[j[l]] += f[l];
+		}
+		kf += 4.f;
+	}
+	for (; k < kmax; k++) {
+		unsigned jk = k * shift;
+		float mk = mag[k] * gain;
+		outMag[jk] += mk;
+		outFrq[jk] += mk * frq[k] * shift;
+	}
+}
+
+/** Divides the frequencies collected by remap() by their magnitude, empty bins get their center frequency */
+inline void weightedFrequency(const float* mag, float* frq, float binFreq, unsigned n) {
+	Dispatch::kernels.weightedFrequency(mag, frq, binFreq, n);
+}
+
+/** First bin at or above freq */
+inline unsigned binFrom(float freq, float binFreq, unsigned numBins) {
+	return unsigned(std::min(std::max(std::ceil(freq / binFreq), 0.f), float(numBins)));
+}
+
+/** First bin above freq */
+inline unsigned binPast(float freq, float binFreq, unsigned numBins) {
+	return unsigned(std::min(std::max(std::floor(freq / binFreq) + 1.f, 0.f), float(numBins)));
+}
+
+/** Zeroes complex bins from..to-1 */
+inline void clearBins(float* bins, unsigned from, unsigned to) {
+	if (to > from)
+		clear(bins + 2 * from, 2 * (to - from));
+}
+
+/** Copies complex bins from..to-1 */
+inline void copyBins(float* dst, const float* src, unsigned from, unsigned to) {
+	if (to > from)
+		copy(dst + 2 * from, src + 2 * from, 2 * (to - from));
+}
+
+} // namespace Spectral
@@ -0,0 +1,183 @@
+#pragma once
+#include "plugin.hpp"
+#include <atomic>
+
+namespace Spectrum {
+
+/**
+ * Single producer, single consumer buffer without locks: the audio thread
+ * always owns one buffer for writing, the UI thread one for reading and the
+ * third one is swapped between them.
+ */
+template <typename T>
+struct TripleBuffer {
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+
+	/** Zeroed, the UI may read before the first frame has been published */
+	T buffers[3] = {};
+	std::atomic<int> middle{1};
+	int back = 0;
+	int front = 2;
+
+	T& write() {
+		return buffers[back];
+	}
+
+	void publish() {
+		back = middle.exchange(back | FRESH) & INDEX;
+	}
+
+	/** Returns true if a newer buffer has been published since the last call */
+	bool read() {
+		if ((middle.load() & FRESH) == 0)
+			return false;
+		front = middle.exchange(front) & INDEX;
+		return true;
+	}
+
+	const T& get() {
+		return buffers[front];
+	}
+};
+
+static const int BANDS = 64;
+static const int MARKERS = 8;
+static const float FREQ_MIN = 20.f;
+static const float FREQ_MAX = 20000.f;
+
+/** Position of a frequency on the logarithmic display axis, 0 to 1 */
+inline float position(float freq) {
+	return std::log(std::max(freq, FREQ_MIN) / FREQ_MIN) / std::log(FREQ_MAX / FREQ_MIN);
+}
+
+struct Frame {
+	float in[BANDS];
+	float out[BANDS];
+	bool hasOut;
+	float markers[MARKERS];
+	int numMarkers;
+};
+
+/** Audio side of the display, decimates the STFT bins into a few logarithmic bands */
+struct Publisher {
+	TripleBuffer<Frame> buffer;
+	/** Set by the display on every UI frame, no work is done on the audio thread without it */
+	std::atomic<bool> requested{false};
+
+	unsigned numBins = 0;
+	float binFreq = 0.f;
+	unsigned start[BANDS + 1];
+
+	/** Returns the frame to fill or NULL if nobody is looking */
+	Frame* begin(unsigned numBins, float binFreq) {
+		if (!requested.exchange(false))
+			return NULL;
+		if (numBins != this->numBins || binFreq != this->binFreq) {
+			this->numBins = numBins;
+			this->binFreq = binFreq;
+			for (int i = 0; i <= BANDS; i++) {
+				float freq = FREQ_MIN * std::pow(FREQ_MAX / FREQ_MIN, float(i) / BANDS);
+				start[i] = std::min(unsigned(freq / binFreq), numBins - 1);
+			}
+		}
+		Frame* frame = &buffer.write();
+		frame->hasOut = false;
+		frame->numMarkers = 0;
+		return frame;
+	}
+
+	/** Keeps the maximum magnitude of the bins within each band, F returns the magnitude of bin k */
+	template <typename F>
+	void decimate(float* dst, F magnitude) {
+		for (int i = 0; i < BANDS; i++) {
+			unsigned end = std::max(start[i + 1], start[i] + 1);
+			float m = 0.f;
+			for (unsigned k = start[i]; k < end; k++) {
+				m = std::max(m, magnitude(k));
+			}
+			dst[i] = m;
+		}
+	}
+
+	void marker(Frame* frame, float freq) {
+		if (frame->numMarkers < MARKERS)
+			frame->markers[frame->numMarkers++] = position(freq);
+	}
+
+	void publish() {
+		buffer.publish();
+	}
+};
+
+struct SpectrumDisplay : widget::TransparentWidget {
+	Publisher* publisher = NULL;
+	/** Frequency runs bottom to top instead of left to right */
+	bool vertical = false;
+	float peak = 0.f;
+
+	void step() override {
+		if (publisher)
+			publisher->requested = true;
+		TransparentWidget::step();
+	}
+
+	void draw(const DrawArgs& args) override {
+		nvgBeginPath(args.vg);
+		nvgRoundedRect(args.vg, 0.f, 0.f, box.size.x, box.size.y, 2.f);
+		nvgFillColor(args.vg, nvgRGB(34, 14, 18));
+		nvgFill(args.vg);
+		if (!publisher)
+			return;
+
+		publisher->buffer.read();
+		const Frame& frame = publisher->buffer.get();
+
+		// Levels are shown relative to a slowly falling peak, 60dB range
+		float m = 1e-6f;
+		for (int i = 0; i < BANDS; i++) {
+			m = std::max(m, frame.in[i]);
+		}
+		peak = std::max(m, peak * 0.98f);
+
+		drawTrace(args, frame.in, nvgRGBA(141, 230, 249, 204));
+		if (frame.hasOut)
+			drawTrace(args, frame.out, nvgRGBA(255, 255, 255, 160));
+
+		nvgBeginPath(args.vg);
+		for (int i = 0; i < frame.numMarkers; i++) {
+			Vec p1 = point(frame.markers[i], 0.f);
+			Vec p2 = point(frame.markers[i], 1.f);
+			nvgMoveTo(args.vg, p1.x, p1.y);
+			nvgLineTo(args.vg, p2.x, p2.y);
+		}
+		nvgStrokeColor(args.vg, nvgRGBA(255, 255, 255, 200));
+		nvgStrokeWidth(args.vg, 0.7f);
+		nvgStroke(args.vg);
+	}
+
+	void drawTrace(const DrawArgs& args, const float* bands, NVGcolor color) {
+		nvgBeginPath(args.vg);
+		Vec p = point(0.f, 0.f);
+		nvgMoveTo(args.vg, p.x, p.y);
+		for (int i = 0; i < BANDS; i++) {
+			float db = 20.f * std::log10(std::max(bands[i], 1e-9f) / peak);
+			float level = clamp(1.f + db / 60.f, 0.f, 1.f);
+			p = point((i + 0.5f) / BANDS, level);
+			nvgLineTo(args.vg, p.x, p.y);
+		}
+		p = point(1.f, 0.f);
+		nvgLineTo(args.vg, p.x, p.y);
+		nvgClosePath(args.vg);
+		nvgFillColor(args.vg, color);
+		nvgFill(args.vg);
+	}
+
+	Vec point(float pos, float level) {
+		if (vertical)
+			return Vec(level * box.size.x, (1.f - pos) * box.size.y);
+		return Vec(pos * box.size.x, (1.f - level) * box.size.y);
+	}
+};
+
+} // namespace Spectrum
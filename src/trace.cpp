@@ -0,0 +1,78 @@
+#include "trace.hpp"
+
+#ifdef PACKGAMMA_TRACE
+#include <thread>
+
+namespace Trace {
+
+Buffer buffer;
+
+Buffer::Buffer() {
+	events = new Event[CAPACITY];
+	for (size_t i = 0; i < CAPACITY; i++) {
+		events[i].name = NULL;
+	}
+	start = std::chrono::steady_clock::now();
+	path = asset::user("PackGamma-trace.json");
+}
+
+Buffer::~Buffer() {
+	dump();
+	delete[] events;
+}
+
+static uint32_t threadId() {
+	static std::atomic<uint32_t> next{0};
+	thread_local uint32_t id = next++;
+	return id;
+}
+
+void Buffer::record(const char* name, int64_t begin, int64_t end) {
+	size_t i = count.fetch_add(1, std::memory_order_relaxed);
+	Event& e = events[i % CAPACITY];
+	e.name.store(NULL, std::memory_order_relaxed);
+	e.begin = begin;
+	e.end = end;
+	e.thread = threadId();
+	e.name.store(name, std::memory_order_release);
+}
+
+bool Buffer::dump() {
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+	size_t n = std::min(count.load(), CAPACITY);
+	std::fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t i = 0; i < n; i++) {
+		const Event& e = events[i];
+		const char* name = e.name.load(std::memory_order_acquire);
+		if (!name)
+			continue;
+		std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			first ? "" : ",\n", name, e.thread, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+		first = false;
+	}
+	std::fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+	std::fclose(file);
+	return true;
+}
+
+struct DumpItem : MenuItem {
+	void onAction(const event::Action& e) override {
+		if (buffer.dump())
+			INFO("Wrote trace to %s", buffer.path.c_str());
+		else
+			WARN("Could not write trace to %s", buffer.path.c_str());
+	}
+};
+
+void appendContextMenu(ui::Menu* menu) {
+	size_t n = std::min(buffer.count.load(), CAPACITY);
+	menu->addChild(new MenuSeparator());
+	menu->addChild(construct<DumpItem>(&MenuItem::text, "Write trace file", &MenuItem::rightText, string::f("%zu events", n)));
+}
+
+} // namespace Trace
+
+#endif
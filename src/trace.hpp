@@ -0,0 +1,79 @@
+#pragma once
+#include "plugin.hpp"
+
+/**
+ * Scoped trace zones for timeline inspection, enabled by building with
+ * `make TRACE=1`. Events are kept in a preallocated buffer and written as a
+ * Chrome trace (chrome://tracing, ui.perfetto.dev) to the Rack user folder
+ * on exit or from the context menu. Without the flag everything compiles away.
+ */
+#ifdef PACKGAMMA_TRACE
+#include <atomic>
+#include <chrono>
+
+namespace Trace {
+
+/** Number of events kept, older ones are overwritten */
+static const size_t CAPACITY = 1 << 19;
+
+struct Event {
+	/** Set last, events without a name are still being written */
+	std::atomic<const char*> name;
+	int64_t begin;
+	int64_t end;
+	uint32_t thread;
+};
+
+struct Buffer {
+	Event* events;
+	std::atomic<size_t> count{0};
+	std::chrono::steady_clock::time_point start;
+	std::string path;
+
+	Buffer();
+	~Buffer();
+
+	int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void record(const char* name, int64_t begin, int64_t end);
+	/** Writes all complete events kept so far, recording continues */
+	bool dump();
+};
+
+extern Buffer buffer;
+
+struct Zone {
+	const char* name;
+	int64_t begin;
+
+	Zone(const char* name) : name(name) {
+		begin = buffer.now();
+	}
+
+	~Zone() {
+		buffer.record(name, begin, buffer.now());
+	}
+};
+
+void appendContextMenu(ui::Menu* menu);
+
+} // namespace Trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+/** Records the enclosing scope under name, which must be a string literal */
+#define TRACE_ZONE(name) Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+
+#else
+
+namespace Trace {
+
+inline void appendContextMenu(ui::Menu* menu) {}
+
+} // namespace Trace
+
+#define TRACE_ZONE(name)
+
+#endif
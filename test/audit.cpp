@@ -0,0 +1,185 @@
+#include "audit.hpp"
+#include "headless.hpp"
+#include "quality.hpp"
+#include "control.hpp"
+#include "shared.hpp"
+#include <context.hpp>
+#include <engine/Engine.hpp>
+#include <cstdio>
+#include <cmath>
+
+/**
+ * Real-time safety audit. Drives every module of the plugin through the
+ * situations of a running patch with the calls of interpose.cpp armed, so
+ * any allocation, lock or file access on the audio path fails the run with
+ * its stack trace. Construction and the changes between the steps happen on
+ * the UI thread in Rack and are not audited.
+ */
+
+/** Frames of each step, enough for several frames of the transforms and control updates */
+static const int FRAMES = 20000;
+
+struct Driver {
+	Module* module;
+	std::string slug;
+	float sampleRate = 48000.f;
+	int64_t frame = 0;
+
+	/** Sets the channels of every input, 0 unplugs them */
+	void connectInputs(int channels) {
+		for (Input& input : module->inputs)
+			input.channels = channels;
+	}
+
+	void connectOutputs(int channels) {
+		for (Output& output : module->outputs)
+			output.channels = channels;
+	}
+
+	/** Rack calls it from the engine when the audio device changes its rate */
+	void changeSampleRate(float rate) {
+		sampleRate = rate;
+		APP->engine->setSampleRate(rate);
+		std::string scope = string::f("onSampleRateChange() of %s", slug.c_str());
+		Audit::arm(scope.c_str());
+		module->onSampleRateChange();
+		Audit::disarm();
+	}
+
+	/** Processes one frame with a sine on every connected channel */
+	void step() {
+		Module::ProcessArgs args;
+		args.sampleRate = sampleRate;
+		args.sampleTime = 1.f / sampleRate;
+		// Each input and channel at its own frequency, the swing crosses the trigger thresholds
+		for (size_t k = 0; k < module->inputs.size(); k++) {
+			Input& input = module->inputs[k];
+			for (int c = 0; c < input.channels; c++) {
+				float f = 30.f * (k + 1) + 17.f * c;
+				input.voltages[c] = 5.f * std::sin(2.f * M_PI * f * (frame / sampleRate));
+			}
+		}
+		module->process(args);
+		frame++;
+	}
+
+	/** Processes FRAMES frames */
+	void process(const char* what) {
+		std::string scope = string::f("process() of %s, %s", slug.c_str(), what);
+		Audit::arm(scope.c_str());
+		for (int i = 0; i < FRAMES; i++) {
+			step();
+		}
+		Audit::disarm();
+	}
+};
+
+/**
+ * Two instances fed from the same output share one analysis. The first one
+ * leads, the second takes over while the leader isn't processed, the old
+ * leader comes back as a follower, then the new one moves to another source.
+ */
+static void auditShared(Model* model) {
+	Driver a, b;
+	a.module = model->createModule();
+	b.module = model->createModule();
+	Shared::Source* sa = dynamic_cast<Shared::Source*>(a.module);
+	Shared::Source* sb = dynamic_cast<Shared::Source*>(b.module);
+	if (!sa || !sb) {
+		delete a.module;
+		delete b.module;
+		return;
+	}
+	a.slug = b.slug = model->slug;
+	// The engine gives the ids when the modules are added, the leader is known by it
+	a.module->id = 1;
+	b.module->id = 2;
+	sa->source.store(int64_t(3) << 16);
+	sb->source.store(int64_t(3) << 16);
+	for (Driver* d : {&a, &b}) {
+		d->connectInputs(1);
+		d->connectOutputs(1);
+	}
+
+	std::string scope = string::f("process() of two %s on the same source", model->slug.c_str());
+	Audit::arm(scope.c_str());
+	for (int i = 0; i < FRAMES; i++) {
+		a.step();
+		b.step();
+	}
+	// The leader stalls, the follower takes over after two hops
+	for (int i = 0; i < FRAMES; i++) {
+		b.step();
+	}
+	for (int i = 0; i < FRAMES; i++) {
+		a.step();
+		b.step();
+	}
+	sb->source.store((int64_t(3) << 16) | 1);
+	for (int i = 0; i < FRAMES; i++) {
+		a.step();
+		b.step();
+	}
+	Audit::disarm();
+
+	delete a.module;
+	delete b.module;
+}
+
+int main() {
+	Audit::init();
+	plugin::Plugin* plugin = Render::init();
+
+	for (Model* model : plugin->models) {
+		APP->engine->setSampleRate(48000.f);
+		int before = Audit::violations();
+		Driver d;
+		d.module = model->createModule();
+		d.slug = model->slug;
+
+		d.process("unpatched");
+		d.connectOutputs(1);
+		d.connectInputs(1);
+		d.process("mono inputs");
+		d.connectInputs(16);
+		d.process("16 channels");
+		d.connectInputs(3);
+		d.process("3 channels");
+		d.connectOutputs(0);
+		d.process("outputs unplugged");
+		d.connectOutputs(1);
+		d.connectInputs(0);
+		d.process("inputs unplugged");
+		d.connectInputs(2);
+		d.process("inputs replugged");
+
+		// Every input read at audio rate and the shortest control division
+		json_t* dataJ = json_object();
+		json_object_set_new(dataJ, "audioRateInputs", json_integer(0xffffffff));
+		json_object_set_new(dataJ, "controlDivision", json_integer(Control::DIVISIONS[0]));
+		d.module->dataFromJson(dataJ);
+		json_decref(dataJ);
+		d.process("audio rate CV");
+
+		// The spectral modules change their hop when the scheduler lowers the quality
+		Quality::scheduler.level = Quality::NUM_LEVELS - 1;
+		d.process("lowest quality");
+		Quality::scheduler.level = Quality::FULL;
+		d.process("full quality");
+
+		d.changeSampleRate(96000.f);
+		d.process("96 kHz");
+		d.changeSampleRate(44100.f);
+		d.process("44.1 kHz");
+
+		delete d.module;
+		APP->engine->setSampleRate(48000.f);
+		auditShared(model);
+		std::printf("%-16s %s\n", d.slug.c_str(), Audit::violations() > before ? "FAIL" : "ok");
+	}
+
+	int violations = Audit::violations();
+	std::printf("%d calls on the audio path\n", violations);
+	Render::destroy();
+	return violations > 0 ? 1 : 0;
+}
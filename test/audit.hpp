@@ -0,0 +1,18 @@
+#pragma once
+
+/**
+ * Allocation, locking and file calls interposed by interpose.cpp for
+ * packgamma-audit. While the audit is armed every such call on the arming
+ * thread is reported with its stack trace.
+ */
+namespace Audit {
+
+/** Resolves the interposed calls, before the first arm() */
+void init();
+/** Reports the calls of this thread until disarm(), scope names the code under test */
+void arm(const char* scope);
+void disarm();
+/** Number of calls reported so far */
+int violations();
+
+} // namespace Audit
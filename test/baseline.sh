@@ -0,0 +1,54 @@
+#!/bin/bash
+
+# Records reference/ from the module behaviour the suite guards, not from the
+# current build. Each case is rendered by the revision it names in "revision",
+# the baseline commit otherwise, built with the current renderer and suite in
+# a temporary worktree. Run from test/ as `make baseline RACK_DIR=...`, with
+# the names of cases to record only those.
+
+set -e
+
+BASELINE=6674377
+RACK_DIR=$(cd "${RACK_DIR:-../../..}" && pwd)
+TOP=$(cd .. && pwd)
+WORK=$(mktemp -d)
+
+cleanup()
+{
+    for tree in "$WORK"/*; do
+        [ -d "$tree" ] && git -C "$TOP" worktree remove --force "$tree"
+    done
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# Builds packgamma-golden in a worktree of revision $1
+prepare()
+{
+    local tree="$WORK/$1"
+    git -C "$TOP" worktree add --detach "$tree" "$1"
+    # Gamma as built here, the old trees have the same submodule
+    rm -rf "$tree/dep/Gamma"
+    mkdir -p "$tree/dep"
+    ln -s "$TOP/dep/Gamma" "$tree/dep/Gamma"
+    rm -rf "$tree/render" "$tree/test"
+    mkdir -p "$tree/render" "$tree/test"
+    cp "$TOP"/render/*.cpp "$TOP"/render/*.hpp "$TOP/render/Makefile" "$tree/render/"
+    cp "$TOP"/test/*.cpp "$TOP"/test/*.hpp "$TOP/test/Makefile" "$tree/test/"
+    cp -r "$TOP/test/cases" "$tree/test/"
+    make -C "$tree/test" packgamma-golden RACK_DIR="$RACK_DIR"
+}
+
+cases="$*"
+if [ -z "$cases" ]; then
+    cases=$(cd cases && ls *.json | sed 's/\.json$//')
+fi
+
+mkdir -p reference
+for name in $cases; do
+    revision=$(sed -n 's/.*"revision": *"\([0-9a-f]*\)".*/\1/p' "cases/$name.json")
+    revision=${revision:-$BASELINE}
+    [ -d "$WORK/$revision" ] || prepare "$revision"
+    (cd "$WORK/$revision/test" && ./packgamma-golden --update "$name")
+    cp "$WORK/$revision/test/reference/$name"-*.wav reference/
+done
@@ -0,0 +1,246 @@
+#include "patch.hpp"
+#include "wav.hpp"
+#include "headless.hpp"
+#include <context.hpp>
+#include <engine/Engine.hpp>
+#include <dirent.h>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+/**
+ * Golden-output regression suite. Every case in cases/ is a patch of the
+ * offline renderer which names a stimulus and the largest deviation from its
+ * reference render in volts. The stimulus is generated, rendered at each
+ * sample rate and compared with reference/CASE-RATE.wav, which --update
+ * records from the current build.
+ */
+
+static const int RATES[] = {44100, 48000, 96000, 192000};
+
+/** Fixed stimulus of a case, the signals are in volts */
+struct Stimulus {
+	std::string type;
+	int channels = 1;
+	float duration = 0.5f;
+
+	/** Frame i at sampleRate into out */
+	void frame(int64_t i, float sampleRate, float* out) const {
+		float t = i / sampleRate;
+		if (type == "sweep") {
+			// Exponential sine sweep from 20 Hz to 20 kHz, or to 0.45 of the sample rate
+			double f1 = std::min(20000.f, 0.45f * sampleRate);
+			double k = std::log(f1 / 20.0) / duration;
+			double phase = 20.0 * (std::exp(k * i / sampleRate) - 1.0) / k;
+			for (int c = 0; c < channels; c++)
+				out[c] = 4.f * std::sin(2.0 * M_PI * phase);
+		}
+		else if (type == "impulses") {
+			// One sample at full scale every 100 ms
+			int64_t period = (int64_t)(0.1f * sampleRate);
+			for (int c = 0; c < channels; c++)
+				out[c] = i % period == 0 ? Render::VOLTS : 0.f;
+		}
+		else if (type == "gates") {
+			// Gates of 10 ms, each channel with its own period so the voices overlap
+			for (int c = 0; c < channels; c++) {
+				int64_t period = (int64_t)((0.07f + 0.03f * c) * sampleRate);
+				out[c] = i % period < (int64_t)(0.01f * sampleRate) ? 10.f : 0.f;
+			}
+		}
+		else if (type == "voct") {
+			// A chord on each channel which moves every 50 ms, spread over four octaves
+			int step = (int)(t / 0.05f);
+			for (int c = 0; c < channels; c++)
+				out[c] = -2.f + ((step * 5 + c * 7) % 48) / 12.f;
+		}
+		else {
+			std::fill(out, out + channels, 0.f);
+		}
+	}
+};
+
+struct Case {
+	std::string name;
+	Render::Patch patch;
+	Stimulus stimulus;
+	/** Largest deviation from the reference in volts */
+	float tolerance = 0.f;
+
+	bool load(const std::string& path, plugin::Plugin* plugin) {
+		if (!patch.load(path, plugin))
+			return false;
+		json_error_t err;
+		json_t* rootJ = json_load_file(path.c_str(), 0, &err);
+		if (!rootJ)
+			return false;
+		DEFER({
+			json_decref(rootJ);
+		});
+		const char* type = json_string_value(json_object_get(rootJ, "stimulus"));
+		if (type)
+			stimulus.type = type;
+		json_t* channelsJ = json_object_get(rootJ, "channels");
+		if (channelsJ)
+			stimulus.channels = clamp((int)json_integer_value(channelsJ), 1, PORT_MAX_CHANNELS);
+		json_t* durationJ = json_object_get(rootJ, "duration");
+		if (durationJ)
+			stimulus.duration = json_number_value(durationJ);
+		tolerance = json_number_value(json_object_get(rootJ, "tolerance"));
+		if (stimulus.type.empty() || tolerance <= 0.f) {
+			patch.error = path + " needs a stimulus and a tolerance";
+			return false;
+		}
+		return true;
+	}
+
+	/** Renders the stimulus and the patch's tail, out holds the interleaved output frames in -1..1 */
+	int render(std::vector<float>& out) const {
+		Render::Chain chain(patch);
+		int64_t length = stimulus.duration * patch.sampleRate;
+		int64_t tail = patch.tail * patch.sampleRate;
+		float in[PORT_MAX_CHANNELS];
+		float frame[PORT_MAX_CHANNELS];
+		int outChannels = 0;
+		out.clear();
+		for (int64_t i = 0; i < length + tail; i++) {
+			if (i < length)
+				stimulus.frame(i, patch.sampleRate, in);
+			else
+				std::fill(in, in + stimulus.channels, 0.f);
+			// The chain takes the samples of the files, in -1..1
+			for (int c = 0; c < stimulus.channels; c++)
+				in[c] /= Render::VOLTS;
+			int channels = chain.process(in, stimulus.channels, frame);
+			if (outChannels == 0)
+				outChannels = std::max(channels, 1);
+			for (int c = 0; c < outChannels; c++)
+				out.push_back(c < channels ? frame[c] : 0.f);
+		}
+		return outChannels;
+	}
+};
+
+static void usage() {
+	std::fprintf(stderr,
+		"Usage: packgamma-golden [--update] [CASE ...]\n"
+		"\n"
+		"Renders the cases in cases/ at 44.1, 48, 96 and 192 kHz and compares them\n"
+		"with their renders in reference/. --update writes the references instead.\n");
+}
+
+int main(int argc, char* argv[]) {
+	bool update = false;
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--update")
+			update = true;
+		else if (arg[0] == '-') {
+			usage();
+			return 2;
+		}
+		else
+			names.push_back(arg);
+	}
+	if (names.empty()) {
+		DIR* dir = opendir("cases");
+		if (!dir) {
+			std::fprintf(stderr, "cases/ not found, run from the test directory\n");
+			return 2;
+		}
+		while (struct dirent* entry = readdir(dir)) {
+			std::string file = entry->d_name;
+			if (file.size() > 5 && file.substr(file.size() - 5) == ".json")
+				names.push_back(file.substr(0, file.size() - 5));
+		}
+		closedir(dir);
+		std::sort(names.begin(), names.end());
+	}
+
+	plugin::Plugin* plugin = Render::init();
+
+	std::vector<Case*> cases;
+	for (const std::string& name : names) {
+		Case* c = new Case;
+		c->name = name;
+		if (!c->load("cases/" + name + ".json", plugin)) {
+			std::fprintf(stderr, "%s: %s\n", name.c_str(), c->patch.error.c_str());
+			return 1;
+		}
+		cases.push_back(c);
+	}
+
+	if (update)
+		system::createDirectory("reference");
+
+	int failed = 0;
+	float worst = 0.f;
+	std::vector<float> out;
+	std::vector<float> ref;
+	for (int rate : RATES) {
+		// Gamma's domain follows the engine, the instances pick the rate up in their constructors
+		APP->engine->setSampleRate(rate);
+		for (Case* c : cases) {
+			c->patch.sampleRate = rate;
+			std::string path = string::f("reference/%s-%d.wav", c->name.c_str(), rate);
+			int channels = c->render(out);
+			int64_t frames = out.size() / channels;
+
+			if (update) {
+				Wav::Writer writer;
+				if (!writer.open(path, channels, rate, 32) || !writer.write(out.data(), frames) || !writer.close()) {
+					std::fprintf(stderr, "%s: %s\n", path.c_str(), writer.error.c_str());
+					failed++;
+					continue;
+				}
+				std::printf("%-40s written\n", path.c_str());
+				continue;
+			}
+
+			Wav::Reader reader;
+			if (!reader.open(path)) {
+				std::printf("%-40s FAIL no reference, record it with --update\n", path.c_str());
+				failed++;
+				continue;
+			}
+			if (reader.channels != channels || reader.remaining != frames) {
+				std::printf("%-40s FAIL %d channels and %d frames, the reference has %d and %d\n",
+					path.c_str(), channels, (int)frames, reader.channels, (int)reader.remaining);
+				failed++;
+				continue;
+			}
+			ref.resize(out.size());
+			if (reader.read(ref.data(), frames) != frames) {
+				std::printf("%-40s FAIL %s\n", path.c_str(), reader.error.c_str());
+				failed++;
+				continue;
+			}
+
+			float deviation = 0.f;
+			int64_t at = 0;
+			for (size_t i = 0; i < out.size(); i++) {
+				float d = std::fabs(out[i] - ref[i]) * Render::VOLTS;
+				// NaN counts as an infinite deviation
+				if (!(d <= deviation)) {
+					deviation = std::isnan(d) ? INFINITY : d;
+					at = i / channels;
+				}
+			}
+			worst = std::max(worst, deviation);
+			bool ok = deviation <= c->tolerance;
+			if (!ok)
+				failed++;
+			std::printf("%-40s %s max deviation %.3g V at %.4f s, tolerance %.3g V\n",
+				path.c_str(), ok ? "ok  " : "FAIL", deviation, at / (float)rate, c->tolerance);
+		}
+	}
+
+	if (!update)
+		std::printf("%d of %d renders failed, max deviation %.3g V\n", failed, (int)(cases.size() * LENGTHOF(RATES)), worst);
+	for (Case* c : cases) {
+		delete c;
+	}
+	Render::destroy();
+	return failed > 0 ? 1 : 0;
+}
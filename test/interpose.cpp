@@ -0,0 +1,172 @@
+// The interposed functions replace the library's, so its inline wrappers must stay out
+#undef _FORTIFY_SOURCE
+#include "audit.hpp"
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+
+// glibc's allocator under the names it keeps next to the public ones
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void __libc_free(void* p);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+/** The next definition of a function after the executable, looked up on first use */
+#define NEXT(name) \
+	static decltype(&::name) next = NULL; \
+	if (!next) \
+		next = (decltype(&::name))dlsym(RTLD_NEXT, #name)
+
+namespace Audit {
+
+static thread_local bool armed = false;
+static const char* armedScope = "";
+static int count = 0;
+
+/** Prints the call and the stack, then stays quiet until the next arm() */
+static void report(const char* call) {
+	armed = false;
+	count++;
+	char message[512];
+	int n = std::snprintf(message, sizeof(message), "\n%s in %s\n", call, armedScope);
+	if (write(STDERR_FILENO, message, std::min(n, (int)sizeof(message) - 1)) < 0)
+		return;
+	void* frames[64];
+	int depth = backtrace(frames, 64);
+	backtrace_symbols_fd(frames, depth, STDERR_FILENO);
+}
+
+void init() {
+	// The unwinder is loaded on the first backtrace(), which allocates
+	void* frames[1];
+	backtrace(frames, 1);
+}
+
+void arm(const char* scope) {
+	armedScope = scope;
+	armed = true;
+}
+
+void disarm() {
+	armed = false;
+}
+
+int violations() {
+	return count;
+}
+
+} // namespace Audit
+
+extern "C" {
+
+void* malloc(size_t size) noexcept {
+	if (Audit::armed)
+		Audit::report("malloc()");
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept {
+	if (Audit::armed)
+		Audit::report("calloc()");
+	return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) noexcept {
+	if (Audit::armed)
+		Audit::report("realloc()");
+	return __libc_realloc(p, size);
+}
+
+void free(void* p) noexcept {
+	if (Audit::armed && p)
+		Audit::report("free()");
+	__libc_free(p);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size) noexcept {
+	if (Audit::armed)
+		Audit::report("posix_memalign()");
+	*p = __libc_memalign(alignment, size);
+	return *p ? 0 : ENOMEM;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+	if (Audit::armed)
+		Audit::report("aligned_alloc()");
+	return __libc_memalign(alignment, size);
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept {
+	if (Audit::armed)
+		Audit::report("pthread_mutex_lock()");
+	NEXT(pthread_mutex_lock);
+	return next(mutex);
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex) noexcept {
+	if (Audit::armed)
+		Audit::report("pthread_mutex_trylock()");
+	NEXT(pthread_mutex_trylock);
+	return next(mutex);
+}
+
+int open(const char* path, int flags, ...) {
+	if (Audit::armed)
+		Audit::report("open()");
+	mode_t mode = 0;
+	if (flags & O_CREAT) {
+		va_list args;
+		va_start(args, flags);
+		mode = va_arg(args, int);
+		va_end(args);
+	}
+	NEXT(open);
+	return next(path, flags, mode);
+}
+
+ssize_t read(int fd, void* buffer, size_t size) {
+	if (Audit::armed)
+		Audit::report("read()");
+	NEXT(read);
+	return next(fd, buffer, size);
+}
+
+ssize_t write(int fd, const void* buffer, size_t size) {
+	if (Audit::armed)
+		Audit::report("write()");
+	NEXT(write);
+	return next(fd, buffer, size);
+}
+
+FILE* fopen(const char* path, const char* mode) {
+	if (Audit::armed)
+		Audit::report("fopen()");
+	NEXT(fopen);
+	return next(path, mode);
+}
+
+size_t fread(void* buffer, size_t size, size_t n, FILE* file) {
+	if (Audit::armed)
+		Audit::report("fread()");
+	NEXT(fread);
+	return next(buffer, size, n, file);
+}
+
+size_t fwrite(const void* buffer, size_t size, size_t n, FILE* file) {
+	if (Audit::armed)
+		Audit::report("fwrite()");
+	NEXT(fwrite);
+	return next(buffer, size, n, file);
+}
+
+} // extern "C"